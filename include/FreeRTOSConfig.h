@@ -56,20 +56,21 @@
 #define configENABLE_MPU                         0
 
 #define configUSE_PREEMPTION                     1
-#define configSUPPORT_STATIC_ALLOCATION          0 // fixes vApplicationGetIdleTaskMemory undefined reference
-#define configSUPPORT_DYNAMIC_ALLOCATION         1
+#define configSUPPORT_STATIC_ALLOCATION          1 // all at link time; see lab7_main.c's main()
+#define configSUPPORT_DYNAMIC_ALLOCATION         0 // no heap: heap_4.c is .unused
 #define configUSE_IDLE_HOOK                      0
 #define configUSE_TICK_HOOK                      0
 #define configCPU_CLOCK_HZ                       ( SystemCoreClock )
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 7 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)5000)
+#define configTOTAL_HEAP_SIZE                    ((size_t)5000) // unused without a heap
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
 #define configQUEUE_REGISTRY_SIZE                8
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION  1
+#define configUSE_TRACE_FACILITY                 1 // task and queue numbers, for lib_trace
 /* USER CODE BEGIN MESSAGE_BUFFER_LENGTH_TYPE */
 /* Defaults to size_t for backward compatibility, but can be changed
    if lengths will always be less than the number of bytes in a size_t. */
@@ -90,6 +91,8 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelayUntil              0
 #define INCLUDE_vTaskDelay                   1
 #define INCLUDE_xTaskGetSchedulerState       1
+#define INCLUDE_uxTaskGetStackHighWaterMark  1 // for the memory report
+#define INCLUDE_xTaskGetIdleTaskHandle       1
 
 #define INCLUDE_vTaskDelay 1
 
@@ -136,6 +139,26 @@ standard names. */
 
 /* USER CODE BEGIN Defines */   	      
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+
+/* Scheduler tracing into a RAM ring (see lib_trace.h), when built with
+PTC_TRACE. Queue events carry the queue's number (vQueueSetQueueNumber());
+notifications, delays and queue events all belong to whichever task is
+running, except the ISR's give, which names the task it wakes. */
+#if defined(PTC_TRACE) && (defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__))
+  #include "lib_trace.h"
+  #define traceTASK_CREATE( pxNewTCB )		ptc_trace_task_created( ( pxNewTCB )->uxTCBNumber, ( pxNewTCB )->pcTaskName )
+  #define traceTASK_SWITCHED_IN()		ptc_trace_event( PTC_TRACE_SWITCH_IN, pxCurrentTCB->uxTCBNumber, 0 )
+  #define traceTASK_SWITCHED_OUT()		ptc_trace_event( PTC_TRACE_SWITCH_OUT, pxCurrentTCB->uxTCBNumber, 0 )
+  #define traceMOVED_TASK_TO_READY_STATE( pxTCB )	ptc_trace_event( PTC_TRACE_READY, ( pxTCB )->uxTCBNumber, 0 )
+  #define traceTASK_DELAY()			ptc_trace_event( PTC_TRACE_DELAY, 0, 0 )
+  #define traceQUEUE_SEND( pxQueue )		ptc_trace_event( PTC_TRACE_QUEUE_SEND, 0, ( pxQueue )->uxQueueNumber )
+  #define traceQUEUE_SEND_FAILED( pxQueue )	ptc_trace_event( PTC_TRACE_QUEUE_SEND_FAILED, 0, ( pxQueue )->uxQueueNumber )
+  #define traceQUEUE_RECEIVE( pxQueue )		ptc_trace_event( PTC_TRACE_QUEUE_RECEIVE, 0, ( pxQueue )->uxQueueNumber )
+  #define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )	ptc_trace_event( PTC_TRACE_QUEUE_BLOCK, 0, ( pxQueue )->uxQueueNumber )
+  #define traceTASK_NOTIFY_GIVE_FROM_ISR()	ptc_trace_event( PTC_TRACE_NOTIFY_GIVE, pxTCB->uxTCBNumber, 0 )
+  #define traceTASK_NOTIFY_TAKE()		ptc_trace_event( PTC_TRACE_NOTIFY_TAKE, 0, 0 )
+  #define traceTASK_NOTIFY_TAKE_BLOCK()		ptc_trace_event( PTC_TRACE_NOTIFY_BLOCK, 0, 0 )
+#endif
 /* USER CODE END Defines */ 
 
 #endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,116 @@
+// Host reference model of the fixed-point biquads in lib_ptc.c.
+// This is written separately from the C engine, on purpose: it's templated on
+// the sample type rather than duplicated, quantizes with its own code, and
+// filters one sample at a time through all sections (the C code goes
+// section-major over a block). If lab7_host_qreport finds the two agree bit
+// for bit, then both implement the arithmetic described in lib_ptc.h.
+
+#ifndef HOST_BIQUAD_FIXED_MODEL_HPP
+#define HOST_BIQUAD_FIXED_MODEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+#include <vector>
+#include "lib_ptc.h"
+
+namespace ptc_host {
+
+// Sample is int32_t for the Q31 engine and int16_t for the Q15 one.
+template <typename Sample>
+class FixedBiquadModel {
+  public:
+    static constexpr int FRAC_BITS = std::numeric_limits<Sample>::digits;
+    static constexpr int MAX_POST_SHIFT = 8;
+
+    FixedBiquadModel (const biquadcoeffs *coeffs, int n_secs, int n_bits)
+	: n_bits_(n_bits), in_shift_(FRAC_BITS - BIQUAD_Q_HEADROOM - n_bits),
+	  secs_(n_secs) {
+	quantize (coeffs);
+    }
+
+    // -1 if the coefficients couldn't be represented.
+    int post_shift () const { return (post_shift_); }
+
+    // Section s's quantized {b0, b1, b2, -a1, -a2}.
+    const std::array<int64_t,5> &coeffs (int s) const { return (secs_[s].c); }
+
+    // Filter one n_bits sample through all sections.
+    int filter (int sample) {
+	int64_t x = saturate ((int64_t)sample * ((int64_t)1 << in_shift_));
+	const int acc_shift = FRAC_BITS - post_shift_;
+	for (Section &sec : secs_) {
+	    // z[] is {x[n-1], x[n-2], y[n-1], y[n-2]}.
+	    int64_t acc = (int64_t)1 << (acc_shift-1);
+	    acc += sec.c[0]*x + sec.c[1]*sec.z[0] + sec.c[2]*sec.z[1]
+		 + sec.c[3]*sec.z[2] + sec.c[4]*sec.z[3];
+	    int64_t y = saturate (acc >> acc_shift);
+	    sec.z = { x, sec.z[0], y, sec.z[2] };
+	    x = y;
+	}
+	return ((int)((x + ((int64_t)1 << (in_shift_-1))) >> in_shift_));
+    }
+
+  private:
+    struct Section {
+	std::array<int64_t,5> c {};
+	std::array<int64_t,4> z {};
+    };
+
+    static int64_t saturate (int64_t v) {
+	return (std::clamp<int64_t> (v, std::numeric_limits<Sample>::min(),
+				     std::numeric_limits<Sample>::max()));
+    }
+
+    void quantize (const biquadcoeffs *coeffs) {
+	const int n = (int) secs_.size();
+
+	// Normalize by a0, and find each section's DC gain.
+	std::vector<std::array<double,5>> real (n);
+	std::vector<double> dc (n);
+	for (int s=0; s<n; ++s) {
+	    const biquadcoeffs &c = coeffs[s];
+	    double a0 = (c.a0 == 0.0f) ? 1.0 : c.a0;
+	    real[s] = { c.b0/a0, c.b1/a0, c.b2/a0, -c.a1/a0, -c.a2/a0 };
+	    dc[s] = (real[s][0]+real[s][1]+real[s][2])
+		  / (1.0 - real[s][3] - real[s][4]);
+	}
+
+	// Give every section but the last unity DC gain; the last one makes
+	// up the difference.
+	double removed = 1.0;
+	for (int s=0; s<n-1; ++s)
+	    if (dc[s] != 0.0) {
+		for (int i=0; i<3; ++i) real[s][i] /= dc[s];
+		removed *= dc[s];
+	    }
+	for (int i=0; i<3; ++i) real[n-1][i] *= removed;
+
+	double biggest = 0.0;
+	for (auto &r : real)
+	    for (double v : r) biggest = std::max (biggest, std::fabs (v));
+	post_shift_ = 0;
+	while (std::ldexp (1.0, post_shift_) <= biggest)
+	    if (++post_shift_ > MAX_POST_SHIFT) {
+		post_shift_ = -1;
+		return;
+	    }
+
+	const int64_t max = ((int64_t)1 << FRAC_BITS) - 1;
+	for (int s=0; s<n; ++s)
+	    for (int i=0; i<5; ++i) {
+		double scaled = std::ldexp (real[s][i], FRAC_BITS-post_shift_);
+		int64_t q = (int64_t) (scaled < 0 ? scaled-0.5 : scaled+0.5);
+		secs_[s].c[i] = std::clamp<int64_t> (q, -max-1, max);
+	    }
+    }
+
+    int n_bits_, in_shift_, post_shift_ = -1;
+    std::vector<Section> secs_;
+};
+
+} // namespace ptc_host
+
+#endif // HOST_BIQUAD_FIXED_MODEL_HPP
@@ -0,0 +1,84 @@
+// Checkpoint files, so that a long job can be restarted after a crash and
+// carry on where it was instead of starting the record over. A checkpoint is
+// a pipeline snapshot (Pipeline::save()) plus where the job was:
+//	offset 0   char[8]   magic "PTCCKPT1"
+//	       8   uint64    next_sample: the first sample not yet processed
+//	      16   uint64    record_bytes: the size of the input record, to
+//			     notice if it has changed since
+//	      24   uint64    out_bytes: how much output had been written (the
+//			     rest is from after the checkpoint, and is dropped)
+//	      32   uint32    state_size
+//	      36   uint32    (zero)
+//	      40             the pipeline state
+// The numbers are in the host's byte order, and the state is raw memory
+// anyway, so a checkpoint only means something to the build that wrote it.
+// save_checkpoint() writes a temporary file and renames it over the old one,
+// so a crash while saving leaves the previous checkpoint intact.
+
+#ifndef HOST_CHECKPOINT_HPP
+#define HOST_CHECKPOINT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace ptc_host {
+
+static const char CHECKPOINT_MAGIC[8] = { 'P','T','C','C','K','P','T','1' };
+
+struct Checkpoint {
+    uint64_t next_sample = 0;
+    uint64_t record_bytes = 0;
+    uint64_t out_bytes = 0;
+    std::vector<uint8_t> state;
+};
+
+// Returns false if the checkpoint couldn't be written (in which case the
+// previous one, if any, is still there).
+inline bool save_checkpoint (const std::string &filename, const Checkpoint &ck) {
+    std::string tmp = filename + ".tmp";
+    FILE *fp = fopen (tmp.c_str(), "wb");
+    if (fp == nullptr)
+	return (false);
+    uint8_t header[40] = {};
+    uint32_t state_size = (uint32_t) ck.state.size();
+    memcpy (&header[0], CHECKPOINT_MAGIC, 8);
+    memcpy (&header[8], &ck.next_sample, 8);
+    memcpy (&header[16], &ck.record_bytes, 8);
+    memcpy (&header[24], &ck.out_bytes, 8);
+    memcpy (&header[32], &state_size, 4);
+    bool ok = (fwrite (header, 1, sizeof header, fp) == sizeof header)
+	   && (fwrite (ck.state.data(), 1, state_size, fp) == state_size);
+    ok &= (fclose (fp) == 0);
+    ok = ok && (rename (tmp.c_str(), filename.c_str()) == 0);
+    if (!ok)
+	remove (tmp.c_str());
+    return (ok);
+}
+
+// Returns false if there's no checkpoint, or it's not one.
+inline bool load_checkpoint (const std::string &filename, Checkpoint &ck) {
+    FILE *fp = fopen (filename.c_str(), "rb");
+    if (fp == nullptr)
+	return (false);
+    uint8_t header[40];
+    uint32_t state_size = 0;
+    bool ok = (fread (header, 1, sizeof header, fp) == sizeof header)
+	   && (memcmp (header, CHECKPOINT_MAGIC, 8) == 0);
+    if (ok) {
+	memcpy (&ck.next_sample, &header[8], 8);
+	memcpy (&ck.record_bytes, &header[16], 8);
+	memcpy (&ck.out_bytes, &header[24], 8);
+	memcpy (&state_size, &header[32], 4);
+	ck.state.resize (state_size);
+	ok = (fread (ck.state.data(), 1, state_size, fp) == state_size);
+    }
+    fclose (fp);
+    return (ok);
+}
+
+} // namespace ptc_host
+
+#endif // HOST_CHECKPOINT_HPP
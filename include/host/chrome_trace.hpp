@@ -0,0 +1,265 @@
+// Turning the board's scheduler trace (lib_trace.h; the dump it sends when
+// it's asked with a 't') into a Chrome trace, which ui.perfetto.dev or
+// chrome://tracing shows as a timeline with a track per task: a slice for
+// each time it ran, an instant for each queue and notification event, and a
+// track for each interrupt that marks itself. And a summary per task of its
+// CPU share, how long it waited to run once it was ready, and how often it
+// was preempted, for lab7_host_telemetry to print.
+
+#ifndef HOST_CHROME_TRACE_HPP
+#define HOST_CHROME_TRACE_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "lib_trace.h"
+
+namespace ptc_host {
+
+// A dump, as its reports come in. The info report starts one (and forgets
+// any before it); the chunks fill in its events.
+struct TraceDump {
+    bool have_info = false;
+    struct ptc_trace_info info;
+    std::vector<struct ptc_trace_event> events;
+    std::vector<bool> got;		// Which of events[] have come.
+
+    bool take_info (const uint32_t *words, uint32_t n_words) {
+	if (!ptc_trace_info_from_words (words, n_words, &info))
+	    return (false);
+	have_info = true;
+	struct ptc_trace_event none = {};
+	events.assign (info.n_events, none);
+	got.assign (info.n_events, false);
+	return (true);
+    }
+    bool take_chunk (const uint32_t *words, uint32_t n_words) {
+	uint32_t first, n;
+	if (!have_info
+	    || !ptc_trace_chunk_from_words (words, n_words, events.data(),
+					    events.size(), &first, &n))
+	    return (false);
+	for (uint32_t i=first; i<first+n; ++i)
+	    got[i] = true;
+	return (true);
+    }
+    uint32_t n_missing () const {
+	uint32_t n = 0;
+	for (bool g : got)
+	    n += !g;
+	return (n);
+    }
+};
+
+// What each task did over the dump.
+struct TraceTaskSummary {
+    uint32_t task = 0;
+    std::string name;
+    double run_us = 0;		// Total time running.
+    uint32_t n_runs = 0;	// Times it was switched in...
+    uint32_t n_preempted = 0;	// ...and out without having blocked.
+    uint32_t n_wakeups = 0;	// Times it was made ready and then ran...
+    double wakeup_us = 0;	// ...the total and the worst of how long that
+    double max_wakeup_us = 0;	// took.
+};
+
+inline const char *trace_isr_name (uint32_t id) {
+    return ((id == PTC_TRACE_ISR_ADC_DMA) ? "ADC DMA" : "ISR");
+}
+inline std::string trace_task_name (const struct ptc_trace_info &info,
+				    uint32_t task) {
+    for (uint32_t t=0; t<info.n_tasks; ++t)
+	if (info.tasks[t].task == task)
+	    return (info.tasks[t].name);
+    return ("task " + std::to_string (task));
+}
+
+// Walks the events that came, in order, turning their times into us from the
+// first, unwrapping the 32-bit counter as it goes. Calls
+//	slice (tid, name, start_us, dur_us, ended)	for each run of a task
+//						(tid = its number; 'ended' is
+//						"blocked" or "preempted") and
+//						of an interrupt (tid = 100 + its
+//						PTC_TRACE_ISR_*; ended "exit"),
+//	instant (tid, name, us, what, value)	for each queue or notification
+//						event, on the running task's
+//						track (what is "queue", "to"
+//						or nullptr for nothing)
+// and returns the per-task summary; *span_us gets the dump's length.
+template <class Slice, class Instant>
+std::vector<TraceTaskSummary> walk_trace (const TraceDump &dump,
+					  double *span_us, Slice slice,
+					  Instant instant) {
+    std::vector<TraceTaskSummary> tasks;
+    auto summary = [&] (uint32_t task) -> TraceTaskSummary & {
+	for (auto &s : tasks)
+	    if (s.task == task)
+		return (s);
+	tasks.push_back (TraceTaskSummary ());
+	tasks.back().task = task;
+	tasks.back().name = trace_task_name (dump.info, task);
+	return (tasks.back());
+    };
+    const double us_per_count = 1.0 / (dump.info.counts_per_us
+				       ? dump.info.counts_per_us : 1);
+    std::vector<double> ready_at (256, -1);	// By task; -1 if not waiting.
+    double isr_at[256];				// By ISR id; -1 if not in it.
+    for (double &t : isr_at)
+	t = -1;
+    uint32_t running = 0;			// 0 if we don't know yet.
+    double running_since = 0;
+    bool blocked = false;
+    uint64_t t = 0;
+    uint32_t last = 0;
+    bool first = true;
+    double us = 0;
+    for (size_t i=0; i<dump.events.size(); ++i) {
+	if (!dump.got[i])
+	    continue;
+	const struct ptc_trace_event &e = dump.events[i];
+	if (!first)
+	    t += (uint32_t) (e.time - last);
+	first = false;
+	last = e.time;
+	us = t * us_per_count;
+	switch (e.type) {
+	  case PTC_TRACE_SWITCH_IN:
+	    running = e.task;
+	    running_since = us;
+	    blocked = false;
+	    ++summary (e.task).n_runs;
+	    if (ready_at[e.task] >= 0) {
+		TraceTaskSummary &s = summary (e.task);
+		double wait = us - ready_at[e.task];
+		++s.n_wakeups;
+		s.wakeup_us += wait;
+		if (wait > s.max_wakeup_us)
+		    s.max_wakeup_us = wait;
+		ready_at[e.task] = -1;
+	    }
+	    break;
+	  case PTC_TRACE_SWITCH_OUT:
+	    if (running == e.task) {
+		TraceTaskSummary &s = summary (e.task);
+		s.run_us += us - running_since;
+		if (!blocked)
+		    ++s.n_preempted;
+		slice (e.task, s.name, running_since, us - running_since,
+		       blocked ? "blocked" : "preempted");
+	    }
+	    running = 0;
+	    break;
+	  case PTC_TRACE_READY:
+	    // A task that's switched out while it's still ready gets here
+	    // too, but it's already waiting; keep when it started.
+	    if ((e.task != running) && (ready_at[e.task] < 0))
+		ready_at[e.task] = us;
+	    break;
+	  case PTC_TRACE_DELAY:
+	  case PTC_TRACE_QUEUE_BLOCK:
+	  case PTC_TRACE_NOTIFY_BLOCK:
+	    blocked = true;
+	    if (e.type == PTC_TRACE_DELAY)
+		break;
+	    if (e.type == PTC_TRACE_QUEUE_BLOCK)
+		instant (running, "queue block", us, "queue", e.arg);
+	    else
+		instant (running, "notify block", us, nullptr, 0);
+	    break;
+	  case PTC_TRACE_QUEUE_SEND:
+	    instant (running, "queue send", us, "queue", e.arg);
+	    break;
+	  case PTC_TRACE_QUEUE_SEND_FAILED:
+	    instant (running, "queue send failed", us, "queue", e.arg);
+	    break;
+	  case PTC_TRACE_QUEUE_RECEIVE:
+	    instant (running, "queue receive", us, "queue", e.arg);
+	    break;
+	  case PTC_TRACE_NOTIFY_GIVE:
+	    instant (running, "notify give", us, "to", e.task);
+	    break;
+	  case PTC_TRACE_NOTIFY_TAKE:
+	    instant (running, "notify take", us, nullptr, 0);
+	    break;
+	  case PTC_TRACE_ISR_ENTER:
+	    isr_at[e.arg & 0xFF] = us;
+	    break;
+	  case PTC_TRACE_ISR_EXIT:
+	    if (isr_at[e.arg & 0xFF] >= 0)
+		slice (100 + (e.arg & 0xFF), trace_isr_name (e.arg),
+		       isr_at[e.arg & 0xFF], us - isr_at[e.arg & 0xFF], "exit");
+	    isr_at[e.arg & 0xFF] = -1;
+	    break;
+	}
+    }
+    if (running != 0)				// Still running at the end.
+	summary (running).run_us += us - running_since;
+    *span_us = us;
+    return (tasks);
+}
+
+// The Chrome trace's JSON. Returns false if it can't be written.
+inline bool write_chrome_trace (FILE *out, const TraceDump &dump) {
+    fprintf (out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+	     "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+	     "\"args\":{\"name\":\"board\"}}");
+    std::vector<uint32_t> named;
+    auto name_track = [&] (uint32_t tid, const std::string &name) {
+	for (uint32_t n : named)
+	    if (n == tid)
+		return;
+	named.push_back (tid);
+	fprintf (out, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		 "\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+		 tid, name.c_str());
+	fprintf (out, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		 "\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%u}}",
+		 tid, tid);
+    };
+    for (uint32_t t=0; t<dump.info.n_tasks; ++t)
+	name_track (dump.info.tasks[t].task, dump.info.tasks[t].name);
+    double span_us;
+    walk_trace (dump, &span_us,
+	[&] (uint32_t tid, const std::string &name, double start, double dur,
+	     const char *ended) {
+	    name_track (tid, (tid >= 100) ? "ISR " + name : name);
+	    fprintf (out, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":\"%s\","
+		     "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"ended\":\"%s\"}}",
+		     tid, name.c_str(), start, dur, ended);
+	},
+	[&] (uint32_t tid, const char *name, double us, const char *what,
+	     uint32_t value) {
+	    fprintf (out, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+		     "\"name\":\"%s\",\"ts\":%.3f", tid, name, us);
+	    if (what != nullptr)
+		fprintf (out, ",\"args\":{\"%s\":%u}", what, value);
+	    fprintf (out, "}");
+	});
+    fprintf (out, "\n]}\n");
+    return (!ferror (out));
+}
+
+// A line per task: its CPU share of the dump, runs, preemptions, and its
+// wakeup latency.
+inline void print_trace_summary (FILE *out, const TraceDump &dump) {
+    double span_us;
+    std::vector<TraceTaskSummary> tasks = walk_trace (dump, &span_us,
+	[] (uint32_t, const std::string &, double, double, const char *) {},
+	[] (uint32_t, const char *, double, const char *, uint32_t) {});
+    fprintf (out, "trace: %u events over %.0f us (%u overwritten before the "
+	     "dump, %u lost on the way)\n", dump.info.n_events, span_us,
+	     dump.info.n_lost, dump.n_missing());
+    fprintf (out, "%-16s %7s %8s %10s %11s %11s\n", "task", "%cpu", "runs",
+	     "preempted", "mean wake", "max wake");
+    for (const TraceTaskSummary &s : tasks)
+	fprintf (out, "%-16s %6.2f%% %8u %10u %9.1fus %9.1fus\n",
+		 s.name.c_str(), span_us ? 100 * s.run_us / span_us : 0.0,
+		 s.n_runs, s.n_preempted,
+		 s.n_wakeups ? s.wakeup_us / s.n_wakeups : 0.0,
+		 s.max_wakeup_us);
+}
+
+} // namespace ptc_host
+
+#endif // HOST_CHROME_TRACE_HPP
@@ -0,0 +1,158 @@
+// Chunk-parallel processing of one long record (e.g., a 24-hour Holter
+// recording, 43M samples at 500 Hz), so that a single record can use every
+// core instead of going through one sequential sample loop.
+//
+// Chunk k owns samples [k*chunk, (k+1)*chunk). Its pipeline starts fresh
+// 'overlap' samples before that (or at 0), and runs through its own samples;
+// only the onsets in its own samples are kept. The overlap is what lets a
+// fresh pipeline catch up with one that has been running all along: the
+// lowpass forgets its initial state, the window fills with real data, the
+// warm-up ends, and the thresholds see enough beats to settle. Given a long
+// enough overlap (default_overlap() below), everything but the thresholds
+// is bit-identical to the sequential run by the chunk boundary. The
+// thresholds track the biggest and smallest recent peaks with a slow decay,
+// so a chunk that starts shortly after a big artifact can disagree with the
+// sequential run for a few beats after its boundary.
+//
+// The tolerance, then: away from chunk boundaries the onsets are exactly the
+// sequential ones; within the first few seconds of a chunk, an onset can be
+// missed, added or moved by a few samples. merge_onsets() drops any onset
+// closer than the refractory period to the one before it, which the
+// sequential pipeline can never produce, so a beat right at a boundary isn't
+// counted by both chunks. compare_onsets() measures the difference, and
+// lab7_host_batch -v reports it.
+
+#ifndef HOST_CHUNKED_HPP
+#define HOST_CHUNKED_HPP
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "ptc_pipeline.hpp"
+#include "host/ecg_record.hpp"
+#include "host/thread_pool.hpp"
+
+namespace ptc_host {
+
+// Ten seconds: many time constants of the lowpass, way more than the window
+// and the warm-up, and some ten beats for the thresholds.
+template <class Cfg>
+constexpr size_t default_overlap () {
+    return (10 * Cfg::sample_rate);
+}
+
+// parse_record() on 'pool', in pieces. Each piece boundary is moved forward
+// past any number or word that it lands in, so the result is exactly what
+// parse_record() would give.
+inline void parse_record_parallel (const char *p, const char *end,
+				   std::vector<int> &samples,
+				   ThreadPool &pool) {
+    const size_t PIECE = 1<<20;
+    auto in_token = [](char c) {
+	return (((unsigned)(c-'0') < 10) || ((unsigned)((c|0x20)-'a') < 26)
+		|| (c == '-'));
+    };
+    std::vector<const char *> cuts = { p };
+    while ((size_t)(end - cuts.back()) > PIECE) {
+	const char *cut = cuts.back() + PIECE;
+	while ((cut < end) && in_token (*cut)) ++cut;
+	cuts.push_back (cut);
+    }
+    cuts.push_back (end);
+
+    std::vector<std::vector<int>> pieces (cuts.size()-1);
+    for (size_t i=0; i<pieces.size(); ++i)
+	pool.submit ([&, i] {
+	    pieces[i].reserve ((cuts[i+1] - cuts[i]) / 5);
+	    parse_record (cuts[i], cuts[i+1], pieces[i]);
+	});
+    pool.wait();
+    for (const std::vector<int> &piece : pieces)
+	samples.insert (samples.end(), piece.begin(), piece.end());
+}
+
+// Concatenate the chunks' onsets (each sorted, chunks in order), dropping
+// any that come within the refractory period of the one before.
+template <class Cfg>
+std::vector<size_t> merge_onsets (const std::vector<std::vector<size_t>> &chunks) {
+    std::vector<size_t> onsets;
+    for (const std::vector<size_t> &chunk : chunks)
+	for (size_t s : chunk)
+	    if (onsets.empty() || (s - onsets.back() > Cfg::refractory_ticks))
+		onsets.push_back (s);
+    return (onsets);
+}
+
+// The QRS onsets (dual_QRS rising edges) in samples[0..n), computed in
+// chunks of 'chunk' samples on 'pool'. If cpu_s isn't null, it gets the
+// time spent summed over the chunks.
+template <class Cfg>
+std::vector<size_t> chunked_onsets (const int *samples, size_t n, size_t chunk,
+				    size_t overlap, ThreadPool &pool,
+				    double *cpu_s = nullptr) {
+    size_t n_chunks = std::max<size_t> (1, (n + chunk-1) / chunk);
+    std::vector<std::vector<size_t>> onsets (n_chunks);
+    std::vector<double> secs (n_chunks, 0.0);
+    std::atomic<bool> ok (true);
+    for (size_t k=0; k<n_chunks; ++k)
+	pool.submit ([&, k] {
+	    auto t0 = std::chrono::steady_clock::now();
+	    size_t own = k*chunk, end = std::min (n, own+chunk);
+	    size_t start = (own > overlap) ? own-overlap : 0;
+	    ptc::Pipeline<Cfg> pipeline;
+	    if (!pipeline.init()) {
+		ok = false;
+		return;
+	    }
+	    for (size_t i=start; i<end; ++i)
+		if (pipeline.step (samples[i]).dual_QRS_rise && (i >= own))
+		    onsets[k].push_back (i);
+	    secs[k] = std::chrono::duration<double> (
+			std::chrono::steady_clock::now() - t0).count();
+	});
+    pool.wait();
+    if (cpu_s != nullptr) {
+	*cpu_s = 0;
+	for (double s : secs) *cpu_s += s;
+    }
+    return (ok ? merge_onsets<Cfg> (onsets) : std::vector<size_t>());
+}
+
+// How two onset lists (both sorted) differ: onsets within 'slack' samples
+// of each other are the same beat.
+struct OnsetDiff {
+    size_t n_same = 0;		// Exactly the same sample.
+    size_t n_moved = 0;		// The same beat, off by up to 'slack'.
+    size_t n_missed = 0;	// Only in the reference.
+    size_t n_extra = 0;		// Only in the other.
+    size_t max_shift = 0;	// The most any same beat moved.
+};
+
+inline OnsetDiff compare_onsets (const std::vector<size_t> &ref,
+				 const std::vector<size_t> &other,
+				 size_t slack) {
+    OnsetDiff d;
+    size_t i=0, j=0;
+    while ((i < ref.size()) && (j < other.size())) {
+	size_t a = ref[i], b = other[j];
+	size_t shift = (a > b) ? a-b : b-a;
+	if (shift <= slack) {
+	    if (shift == 0) ++d.n_same; else ++d.n_moved;
+	    d.max_shift = std::max (d.max_shift, shift);
+	    ++i;  ++j;
+	} else if (a < b) {
+	    ++d.n_missed;  ++i;
+	} else {
+	    ++d.n_extra;  ++j;
+	}
+    }
+    d.n_missed += ref.size() - i;
+    d.n_extra += other.size() - j;
+    return (d);
+}
+
+} // namespace ptc_host
+
+#endif // HOST_CHUNKED_HPP
@@ -0,0 +1,42 @@
+// Printing lib_sample_clock.h's stats, for the host tools that get them:
+// lab7_host_telemetry (from the board's clock reports) and lab7_host_acquire
+// (from its own simulation of the acquisition path).
+
+#ifndef HOST_CLOCK_REPORT_HPP
+#define HOST_CLOCK_REPORT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lib_sample_clock.h"
+
+namespace ptc_host {
+
+// A couple of summary lines, then the two lateness histograms side by side
+// (just the rows that have anything in them).
+inline void print_clock_stats (FILE *out, const struct sample_clock_stats &st) {
+    fprintf (out, "sample clock: %.3f Hz achieved over %u blocks; "
+	     "%u overruns (worst arrival %u us late)\n",
+	     st.rate_mhz / 1000.0, st.n_arrived, st.n_overruns,
+	     st.max_arrival_late_us);
+    fprintf (out, "main loop: %u blocks, %u missed deadlines "
+	     "(worst done %u us after release)\n",
+	     st.n_checked, st.n_missed, st.max_done_late_us);
+    fprintf (out, "%16s %10s %10s\n", "lateness (us)", "arrival", "done");
+    for (int b=0; b<SAMPLE_CLOCK_N_BUCKETS; ++b) {
+	if ((st.arrival_hist[b] == 0) && (st.done_hist[b] == 0))
+	    continue;
+	char range[32];
+	if (b == 0)
+	    snprintf (range, sizeof range, "< 1");
+	else if (b == SAMPLE_CLOCK_N_BUCKETS-1)
+	    snprintf (range, sizeof range, ">= %u", 1u << (b-1));
+	else
+	    snprintf (range, sizeof range, "%u - %u", 1u << (b-1), (1u << b) - 1);
+	fprintf (out, "%16s %10u %10u\n", range, st.arrival_hist[b],
+		 st.done_hist[b]);
+    }
+}
+
+} // namespace ptc_host
+
+#endif // HOST_CLOCK_REPORT_HPP
@@ -0,0 +1,88 @@
+// Host-only helpers for reading canned ECG records (the files in data/).
+// The records come in a few flavors: one number per line, ten
+// comma-separated numbers per line, and sometimes a line of chatter from the
+// capture program ("Type the letter 'g' to go"). We just pull out every
+// integer in the file and ignore everything else.
+// The batch tools parse thousands of records, so this reads the whole file
+// with one fread() and scans it by hand, rather than going through streams
+// or strtol() per number.
+
+#ifndef HOST_ECG_RECORD_HPP
+#define HOST_ECG_RECORD_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace ptc_host {
+
+// Read a whole file into 'text'. Returns false if it can't be read.
+inline bool read_file (const std::string &filename, std::string &text) {
+    FILE *fp = fopen (filename.c_str(), "rb");
+    if (fp == nullptr)
+	return (false);
+    text.clear();
+    char buf[1<<16];
+    size_t n;
+    while ((n = fread (buf, 1, sizeof buf, fp)) > 0)
+	text.append (buf, n);
+    bool ok = !ferror (fp);
+    fclose (fp);
+    return (ok);
+}
+
+// Pull every integer out of the text [p,end) and append it to 'samples'.
+inline void parse_record (const char *p, const char *end,
+			  std::vector<int> &samples) {
+    auto is_digit = [](char c) { return ((unsigned)(c-'0') < 10); };
+    auto is_alpha = [](char c) { return ((unsigned)((c|0x20)-'a') < 26); };
+
+    while (p < end) {
+	char c = *p;
+	if (is_digit (c) || (c=='-' && p+1<end && is_digit (p[1]))) {
+	    // A number starts with a digit, or a '-' right before a digit.
+	    bool neg = (c == '-');
+	    p += neg;
+	    int v = 0;
+	    while (p < end && is_digit (*p))
+		v = v*10 + (*p++ - '0');
+	    samples.push_back (neg? -v : v);
+	} else if (is_alpha (c)) {
+	    // Skip whole words, so that e.g. "lead2" doesn't give us a 2.
+	    while (p < end && (is_alpha (*p) || is_digit (*p))) ++p;
+	} else
+	    ++p;
+    }
+}
+
+// What the pipeline gets for a value read from a record: lab7_host has
+// always fed it the values doubled, and its thresholds are tuned to that.
+// Every tool that runs a record (or lab7_host_synth's imitation of one)
+// through the pipeline and reports its beats goes through here, so they all
+// agree: lab7_host and its _batch, _multilead, _acquire, _serve and
+// _telemetry -e. lab7_host_bench and lab7_host_qreport only time the kernels
+// or compare them with each other, and take the values as they are.
+inline int record_sample (int val) {
+    return (val * 2);
+}
+
+inline void scale_record (std::vector<int> &samples) {
+    for (int &s : samples)
+	s = record_sample (s);
+}
+
+// Read every integer in 'filename' into 'samples'. Returns false if the file
+// can't be opened.
+inline bool load_record (const std::string &filename, std::vector<int> &samples) {
+    std::string text;
+    if (!read_file (filename, text))
+	return (false);
+    samples.clear();
+    samples.reserve (text.size() / 5);	// "2048," is typical.
+    parse_record (text.data(), text.data() + text.size(), samples);
+    return (true);
+}
+
+} // namespace ptc_host
+
+#endif // HOST_ECG_RECORD_HPP
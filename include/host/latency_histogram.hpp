@@ -0,0 +1,78 @@
+// A log-linear latency histogram (like HdrHistogram, much simplified): each
+// power of two is split into SUB buckets, so any value is recorded to within
+// 1/SUB of itself, from 1 ns to hours, in a few KB. Recording is a couple of
+// instructions; keep one per thread and merge() them at the end.
+
+#ifndef HOST_LATENCY_HISTOGRAM_HPP
+#define HOST_LATENCY_HISTOGRAM_HPP
+
+#include <stdint.h>
+#include <algorithm>
+
+namespace ptc_host {
+
+class LatencyHistogram {
+  public:
+    void record (uint64_t v) {
+	++counts_[bucket (v)];
+	++n_;
+	max_ = std::max (max_, v);
+	sum_ += v;
+    }
+
+    void merge (const LatencyHistogram &h) {
+	for (int b=0; b<N_BUCKETS; ++b) counts_[b] += h.counts_[b];
+	n_ += h.n_;
+	max_ = std::max (max_, h.max_);
+	sum_ += h.sum_;
+    }
+
+    // The value at or below which fraction q (0..1) of the recorded values
+    // fall; it's the top of a bucket, so at most 1/SUB high.
+    uint64_t percentile (double q) const {
+	if (n_ == 0)
+	    return (0);
+	uint64_t rank = (uint64_t) (q * n_), seen = 0;
+	for (int b=0; b<N_BUCKETS; ++b)
+	    if ((seen += counts_[b]) > rank)
+		return (std::min (top (b), max_));
+	return (max_);
+    }
+
+    // How many recorded values were over 'limit' (to within a bucket).
+    uint64_t count_over (uint64_t limit) const {
+	uint64_t n = 0;
+	for (int b=bucket (limit)+1; b<N_BUCKETS; ++b) n += counts_[b];
+	return (n);
+    }
+
+    uint64_t count () const { return (n_); }
+    uint64_t max () const { return (max_); }
+    double mean () const { return (n_ ? (double)sum_ / n_ : 0.0); }
+
+  private:
+    static const int SUB_BITS = 5, SUB = 1 << SUB_BITS;
+    static const int N_BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    // Values below SUB get a bucket each; above that, the top SUB_BITS+1
+    // bits pick the bucket.
+    static int bucket (uint64_t v) {
+	if (v < (uint64_t)SUB)
+	    return ((int) v);
+	int shift = 63 - __builtin_clzll (v) - SUB_BITS;
+	return ((shift+1) * SUB + (int) ((v >> shift) - SUB));
+    }
+    static uint64_t top (int b) {	// The biggest value in bucket b.
+	if (b < SUB)
+	    return ((uint64_t) b);
+	int shift = b / SUB - 1;
+	return ((((uint64_t)(b % SUB + SUB) + 1) << shift) - 1);
+    }
+
+    uint64_t counts_[N_BUCKETS] = {};
+    uint64_t n_ = 0, max_ = 0, sum_ = 0;
+};
+
+} // namespace ptc_host
+
+#endif // HOST_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,81 @@
+// Printing lib_memory.h's report, for lab7_host_telemetry (from the board's
+// reports) and lab7_host_acquire (from its own run); and, for the latter,
+// measuring how much stack a piece of code needs, by running it on a stack
+// of its own that's painted beforehand, as the kernel paints the tasks'.
+
+#ifndef HOST_MEMORY_REPORT_HPP
+#define HOST_MEMORY_REPORT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+#include <functional>
+#include <vector>
+#include "lib_memory.h"
+
+namespace ptc_host {
+
+// A line per task, with its stack's size, the least it's had left, and a
+// warning when that's under a tenth; then each block pool's use; then the
+// heap's use and fragmentation (the share of the free space that isn't in
+// the largest block).
+inline void print_memory_report (FILE *out, const struct ptc_mem_report &r) {
+    fprintf (out, "%-8s %8s %8s %6s\n", "task", "stack w", "min free",
+	     "used");
+    for (uint32_t i=0; i<r.n_tasks; ++i) {
+	const struct ptc_mem_task &t = r.tasks[i];
+	uint32_t used = (t.stack_min_free_words < t.stack_words)
+		      ? t.stack_words - t.stack_min_free_words : 0;
+	fprintf (out, "%-8s %8u %8u %5.0f%%%s\n", t.name, t.stack_words,
+		 t.stack_min_free_words,
+		 t.stack_words ? 100.0 * used / t.stack_words : 0.0,
+		 (t.stack_min_free_words * 10 < t.stack_words)
+		 ? "  <- under 10% left" : "");
+    }
+    for (uint32_t i=0; i<r.n_pools; ++i) {
+	const struct ptc_mem_pool &m = r.pools[i];
+	fprintf (out, "pool %u: %u blocks of %u bytes, %u in use (at most %u), "
+		 "%u allocations, %u failed\n", i, m.n_blocks, m.block_size,
+		 m.n_blocks - m.n_free, m.n_blocks - m.min_free, m.n_allocs,
+		 m.n_failed);
+    }
+    if (!r.have_heap) {
+	fprintf (out, "no heap stats\n");
+	return;
+    }
+    const struct ptc_mem_heap &h = r.heap;
+    fprintf (out, "heap: %u bytes, %u free (at least %u ever), %u allocations, "
+	     "%u frees\n", h.total, h.free, h.min_free, h.n_allocs, h.n_frees);
+    fprintf (out, "  %u free blocks, %u to %u bytes; %.0f%% of the free space "
+	     "is outside the largest\n", h.n_free_blocks, h.smallest_free,
+	     h.largest_free,
+	     h.free ? 100.0 * (h.free - h.largest_free) / h.free : 0.0);
+}
+
+// Runs fn() on a fresh stack of 'size' bytes, painted with a known byte, and
+// returns how many of them it used at most (the unpainted ones, counting from
+// the top, since the stack grows down). It's the host's compiler and ABI, so
+// it's a guide to what the board needs, not a measure of it.
+inline size_t stack_used_by (const std::function<void ()> &fn,
+			     size_t size = 1 << 20) {
+    const uint8_t paint = 0xA5;		// As tskSTACK_FILL_BYTE.
+    std::vector<uint8_t> stack (size, paint);
+    static ucontext_t caller, callee;
+    static const std::function<void ()> *run;
+    run = &fn;
+    getcontext (&callee);
+    callee.uc_stack.ss_sp = stack.data();
+    callee.uc_stack.ss_size = size;
+    callee.uc_link = &caller;
+    makecontext (&callee, [] () { (*run) (); }, 0);
+    swapcontext (&caller, &callee);
+    size_t unused = 0;
+    while ((unused < size) && (stack[unused] == paint))
+	++unused;
+    return (size - unused);
+}
+
+} // namespace ptc_host
+
+#endif // HOST_MEMORY_REPORT_HPP
@@ -0,0 +1,67 @@
+// Printing lib_profile.h's per-stage stats, for the host tools that get them:
+// lab7_host_telemetry (from the board's profile reports) and
+// lab7_host_acquire (built with -DPTC_PROFILE, from its own run). The times
+// are converted to ns with the counter's rate, so the board's cycles and the
+// host's TSC counts come out comparable.
+
+#ifndef HOST_PROFILE_REPORT_HPP
+#define HOST_PROFILE_REPORT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lib_profile.h"
+
+namespace ptc_host {
+
+// The top of histogram bucket b, in counts.
+inline uint64_t profile_bucket_top (int b) {
+    return ((b == 0) ? 0 : (1ull << b) - 1);
+}
+
+// Roughly the q'th quantile (0..1) of a stage, in counts: the top of the
+// power-of-two bucket it falls in, so up to 2x high (but never over max).
+inline uint64_t profile_quantile (const struct ptc_prof_stats &s, double q) {
+    uint64_t rank = (uint64_t) (q * s.n), seen = 0;
+    for (int b=0; b<PTC_PROF_N_BUCKETS; ++b)
+	if ((seen += s.hist[b]) > rank)
+	    return ((profile_bucket_top (b) < s.max) ? profile_bucket_top (b)
+						      : s.max);
+    return (s.max);
+}
+
+// One line per stage that has anything: the count, min/mean/p99/max per
+// measurement, and the cost per sample as a share of the sample period. Then
+// the headroom, from the whole-block stage if there is one.
+// stats[] is indexed by stage; counts_per_us[] likewise (stages from a board
+// dump each carry their own).
+inline void print_profile (FILE *out, const struct ptc_prof_stats *stats,
+			   const uint32_t *counts_per_us,
+			   double sample_period_us) {
+    fprintf (out, "%-10s %10s %9s %9s %9s %9s %11s %8s\n", "stage", "n",
+	     "min ns", "mean ns", "p99 ns", "max ns", "ns/sample", "%period");
+    for (int st=0; st<PTC_PROF_N_STAGES; ++st) {
+	const struct ptc_prof_stats &s = stats[st];
+	if ((s.n == 0) || (counts_per_us[st] == 0))
+	    continue;
+	double ns = 1000.0 / counts_per_us[st];
+	double per_sample = (double) s.sum * ns / (s.n_samples ? s.n_samples : 1);
+	fprintf (out, "%-10s %10u %9.0f %9.0f %9.0f %9.0f %11.1f %7.3f%%\n",
+		 ptc_prof_stage_name (st), s.n, s.min * ns,
+		 (double) s.sum * ns / s.n, profile_quantile (s, 0.99) * ns,
+		 s.max * ns, per_sample,
+		 100 * per_sample / (sample_period_us * 1000));
+    }
+    const struct ptc_prof_stats &b = stats[PTC_PROF_BLOCK];
+    if ((b.n_samples > 0) && (counts_per_us[PTC_PROF_BLOCK] != 0)) {
+	double per_sample_us = (double) b.sum / b.n_samples
+			     / counts_per_us[PTC_PROF_BLOCK];
+	fprintf (out, "the main loop uses %.2f%% of the sample period, "
+		 "so it could run %.0f times the work\n",
+		 100 * per_sample_us / sample_period_us,
+		 sample_period_us / per_sample_us);
+    }
+}
+
+} // namespace ptc_host
+
+#endif // HOST_PROFILE_REPORT_HPP
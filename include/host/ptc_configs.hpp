@@ -0,0 +1,59 @@
+// The compile-time pipeline configurations (see ptc_pipeline.hpp) that the
+// host tools can choose between by name. with_config() maps a name to its
+// Config type once, up front; everything after that is a separate
+// instantiation, so there's no per-sample cost to having a choice.
+
+#ifndef HOST_PTC_CONFIGS_HPP
+#define HOST_PTC_CONFIGS_HPP
+
+#include <ostream>
+#include <string>
+#include "ptc_pipeline.hpp"
+
+namespace ptc_host {
+
+using ConfigFloat   = ptc::Config<500, 200, ptc::FloatLowpass<ptc::BoardLowpass>>;
+using ConfigW150    = ptc::Config<500, 150, ptc::Q31Lowpass<ptc::BoardLowpass>>;
+using Config250Hz   = ptc::Config<250, 200, ptc::Q31Lowpass<ptc::Lowpass20Hz<250>>>;
+using Config360Hz   = ptc::Config<360, 200, ptc::Q31Lowpass<ptc::Lowpass20Hz<360>>>;
+using Config1000Hz  = ptc::Config<1000, 200,
+				  ptc::Q31Lowpass<ptc::Lowpass20Hz<1000>>>;
+using ConfigBandpass = ptc::Config<500, 200,
+				   ptc::Fir<ptc::Bandpass5to15HzTaps<500>>>;
+
+// X (name, description, Config type). Records must of course have been
+// sampled at the configuration's rate.
+#define PTC_HOST_CONFIGS(X)						\
+    X ("board", "what the board runs (500 Hz, see ptc::Board)", ptc::Board) \
+    X ("float", "500 Hz, float lowpass", ptc_host::ConfigFloat)		\
+    X ("w150", "500 Hz, 150ms window (as in the Pan-Tompkins paper)",	\
+       ptc_host::ConfigW150)						\
+    X ("250", "250 Hz", ptc_host::Config250Hz)				\
+    X ("360", "360 Hz (MIT-BIH records)", ptc_host::Config360Hz)	\
+    X ("1000", "1 kHz", ptc_host::Config1000Hz)				\
+    X ("bp", "500 Hz, 5-15 Hz FIR bandpass instead of the lowpass",	\
+       ptc_host::ConfigBandpass)
+
+template <class Cfg> struct ConfigTag { using type = Cfg; };
+
+// Call f(ConfigTag<Cfg>()) for the Config called 'name'. Returns false if
+// there's no such configuration.
+template <class F>
+bool with_config (const std::string &name, F &&f) {
+#define PTC_HOST_CONFIG_CASE(n, what, Cfg)				\
+    if (name == n) { f (ConfigTag<Cfg>()); return (true); }
+    PTC_HOST_CONFIGS (PTC_HOST_CONFIG_CASE)
+#undef PTC_HOST_CONFIG_CASE
+    return (false);
+}
+
+inline void list_configs (std::ostream &os) {
+#define PTC_HOST_CONFIG_LIST(n, what, Cfg)				\
+    os << "\t" << n << "\t" << what << std::endl;
+    PTC_HOST_CONFIGS (PTC_HOST_CONFIG_LIST)
+#undef PTC_HOST_CONFIG_LIST
+}
+
+} // namespace ptc_host
+
+#endif // HOST_PTC_CONFIGS_HPP
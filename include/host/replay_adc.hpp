@@ -0,0 +1,81 @@
+// A host stand-in for the board's timer-triggered DMA acquisition
+// (ADC1_start_dma() in lib_ADC.c): it replays a canned record into a
+// circular buffer of two halves, from its own thread, and calls a "half
+// done" handler each time a half fills, just as the DMA half-transfer and
+// transfer-complete interrupts do on the board. So the code downstream of
+// the DMA interrupt (the sample ring and the block-draining main loop) runs
+// on the host unchanged; see lab7_host_acquire.
+// The pacing is by absolute deadlines, like TIM6: a block that's handed
+// over late doesn't push the later ones back.
+
+#ifndef HOST_REPLAY_ADC_HPP
+#define HOST_REPLAY_ADC_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace ptc_host {
+
+class ReplayAdc {
+  public:
+    // Called from the replay thread with the half that just filled; and
+    // then once more with n=0 at the end of the record (which the board, of
+    // course, never sees).
+    using HalfDone = std::function<void (const uint16_t *block, uint32_t n)>;
+
+    ~ReplayAdc () { stop(); }
+
+    // Start replaying samples[] into buf[n] (n even), at rate_hz samples per
+    // second, or flat out if rate_hz is 0. Samples
+    // are clamped to 12 bits, as the ADC would. At the end of the record,
+    // the last partial half (if any) is handed over too.
+    void start (const std::vector<int> &samples, uint16_t *buf, uint32_t n,
+		double rate_hz, HalfDone half_done) {
+	stop();
+	thread_ = std::thread ([=, &samples] {
+	    using Clock = std::chrono::steady_clock;
+	    const uint32_t half = n / 2;
+	    const auto t0 = Clock::now();
+	    size_t pos = 0;
+	    for (uint64_t k=0; !stop_ && (pos < samples.size()); ++k) {
+		uint16_t *dst = buf + (k & 1) * half;
+		uint32_t len = 0;
+		for (; (len < half) && (pos < samples.size()); ++len, ++pos) {
+		    int s = samples[pos];
+		    dst[len] = (uint16_t) (s < 0 ? 0 : (s > 4095 ? 4095 : s));
+		}
+		if (rate_hz > 0)
+		    std::this_thread::sleep_until (t0 + std::chrono::duration
+			<double> ((double) pos / rate_hz));
+		half_done (dst, len);
+	    }
+	    half_done (buf, 0);
+	});
+    }
+
+    // Wait until the whole record has been handed over.
+    void wait () {
+	if (thread_.joinable())
+	    thread_.join();
+    }
+
+    // Stop early.
+    void stop () {
+	stop_ = true;
+	if (thread_.joinable())
+	    thread_.join();
+	stop_ = false;
+    }
+
+  private:
+    std::thread thread_;
+    std::atomic<bool> stop_ {false};
+};
+
+} // namespace ptc_host
+
+#endif // HOST_REPLAY_ADC_HPP
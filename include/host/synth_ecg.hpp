@@ -0,0 +1,422 @@
+// A deterministic synthetic ECG, for load and soak tests far longer than the
+// canned records in data/. Real beats are cut out of those records, then
+// time-warped and stitched back together at a controllable heart rate, with
+// baseline wander, mains hum, noise and artifacts on top. The same seed and
+// parameters always give the same stream (on the same build), and the
+// generator reports where it put every beat, as ground truth.
+//
+// - The beats: BeatLibrary finds the QRS complexes in a record (the
+//   steepest spots, well apart) and keeps every full cycle between two of
+//   them, from 200ms before one QRS to 200ms before the next, with the
+//   straight line between its two ends taken out, so that any cycle can
+//   follow any other without a step. Each record is one "source"; a virtual
+//   patient's beats all come from one source.
+// - The rhythm: the rate wanders slowly around its mean (a sine of
+//   swing_bpm over swing_period_s), each interval gets some jitter, and
+//   every so often an episode moves the rate up or down for a minute or
+//   two. Each cycle is warped to its interval: the QRS keeps its width (the
+//   source records are 500 Hz), and the rest of the cycle takes up the
+//   slack.
+// - On top: wander (a slow sine, like breathing), mains hum, white-ish
+//   noise, and artifacts (motion steps that decay away, bursts of muscle
+//   noise, and the lead coming off, which rails the ADC).
+// The ground truth is the sample of each beat's steepest QRS slope, which is
+// where the beat's source QRS was found.
+// Everything is cheap per sample (a table lookup, two phasor rotations and a
+// few integer ops, all vectorized) so that the generator can run at hundreds
+// of Msamples/s.
+
+#ifndef HOST_SYNTH_ECG_HPP
+#define HOST_SYNTH_ECG_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace ptc_host {
+
+// splitmix64: tiny, fast, and the same everywhere (unlike the std::
+// distributions).
+class Rng {
+  public:
+    explicit Rng (uint64_t seed=0) : state_ (seed) {}
+    uint64_t next () {
+	uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return (z ^ (z >> 31));
+    }
+    double uniform () { return ((next() >> 11) * 0x1.0p-53); }	// [0,1)
+    double uniform (double lo, double hi) { return (lo + (hi-lo)*uniform()); }
+    double gaussian () {	// Box-Muller.
+	double u = 1.0 - uniform(), v = uniform();
+	return (sqrt (-2.0*log (u)) * cos (2*M_PI*v));
+    }
+    double exponential (double mean) { return (-mean * log (1.0-uniform())); }
+
+  private:
+    uint64_t state_;
+};
+
+// One cardiac cycle at 500 Hz, from 200ms before its QRS to 200ms before the
+// next one; it starts and ends at 0. (The last sample of x, which is 0, is
+// really the next cycle's first.)
+struct BeatTemplate {
+    std::vector<float> x;
+    int qrs;		// Where in x the QRS is (its steepest point).
+};
+
+class BeatLibrary {
+  public:
+    static const int RATE = 500;		// Of the source records.
+    static const int PRE = RATE / 5;		// 200ms before the QRS.
+    static const int MIN_RR = RATE * 3 / 10, MAX_RR = RATE * 2;
+
+    // Cut the beats out of a record and add them as a new source, if there
+    // are any. Returns how many were found.
+    size_t add_record (const std::vector<int> &x) {
+	size_t n = x.size();
+	if (n < 2*MIN_RR)
+	    return (0);
+	auto slope = [&x] (size_t i) { return (abs (x[i+2] - x[i-2])); };
+
+	// A QRS is a spot at least half as steep as the steepest one; but if
+	// the steepest isn't way steeper than usual, it's not an ECG.
+	std::vector<int> slopes;
+	for (size_t i=2; i+2<n; ++i) slopes.push_back (slope (i));
+	std::nth_element (slopes.begin(), slopes.begin()+slopes.size()/2,
+			  slopes.end());
+	int median = slopes[slopes.size()/2];
+	int steepest = *std::max_element (slopes.begin(), slopes.end());
+	if (steepest < 6*std::max (median, 1))
+	    return (0);
+
+	std::vector<size_t> qrs;
+	const size_t QRS_WIDTH = RATE / 10;
+	for (size_t i=2; i+2<n; ) {
+	    if (2*slope (i) < steepest) { ++i; continue; }
+	    size_t f = i;
+	    for (size_t j=i; (j+2<n) && (j<i+QRS_WIDTH); ++j)
+		if (slope (j) > slope (f)) f = j;
+	    if (qrs.empty() || (f - qrs.back() >= (size_t)MIN_RR))
+		qrs.push_back (f);
+	    i = f + QRS_WIDTH;
+	}
+
+	std::vector<BeatTemplate> beats;
+	for (size_t k=0; k+1<qrs.size(); ++k) {
+	    size_t rr = qrs[k+1] - qrs[k];
+	    if ((qrs[k] < (size_t)PRE) || (rr < (size_t)MIN_RR)
+		|| (rr > (size_t)MAX_RR))
+		continue;
+	    size_t start = qrs[k] - PRE, end = qrs[k+1] - PRE;
+	    BeatTemplate b;
+	    b.qrs = PRE;
+	    for (size_t j=0; j<=rr; ++j)
+		b.x.push_back ((float) (x[start+j] - (x[start]
+			       + (double)(x[end] - x[start]) * j / rr)));
+	    beats.push_back (std::move (b));
+	}
+	if (!beats.empty())
+	    sources_.push_back (beats);
+	return (beats.size());
+    }
+
+    size_t n_sources () const { return (sources_.size()); }
+    const std::vector<BeatTemplate> &source (size_t i) const {
+	return (sources_[i]);
+    }
+
+  private:
+    std::vector<std::vector<BeatTemplate>> sources_;
+};
+
+// All amplitudes are in ADC counts.
+struct SynthParams {
+    uint64_t seed = 1;
+    int sample_rate = 500;
+    int baseline = 2048;		// The output is clamped to 12 bits.
+    double beat_gain = 1.0;		// Times the source beats' size.
+    double bpm = 72;
+    double swing_bpm = 8, swing_period_s = 300;
+    double jitter = 0.03;		// Of each R-R interval (1 sigma).
+    double episodes_per_hour = 2;	// Sudden rate changes.
+    double wander = 150, wander_hz = 0.25;
+    double mains = 20, mains_hz = 60;
+    double noise = 6;			// Peak.
+    double artifacts_per_min = 0.5;
+    double artifact_size = 800;
+};
+
+// A different virtual patient for each i: its own seed, and its own rate,
+// beat size, wander and noise, all drawn from 'base'.
+inline SynthParams vary_patient (const SynthParams &base, uint64_t i) {
+    SynthParams p = base;
+    Rng rng (base.seed ^ (0xD1B54A32D192ED03ull * (i+1)));
+    p.seed = rng.next();
+    p.bpm = base.bpm * rng.uniform (0.8, 1.3);
+    p.beat_gain = base.beat_gain * rng.uniform (0.6, 1.4);
+    p.wander = base.wander * rng.uniform (0.5, 1.5);
+    p.noise = base.noise * rng.uniform (0.5, 2.0);
+    return (p);
+}
+
+class SynthEcg {
+  public:
+    // The library must have at least one source, and outlive the generator.
+    SynthEcg (const BeatLibrary &lib, const SynthParams &p)
+	: p_ (p), rng_ (p.seed),
+	  beats_ (&lib.source (Rng(p.seed).next() % lib.n_sources())) {
+	double g = p_.sample_rate / (double)BeatLibrary::RATE;
+	qrs_half_ = (int) (0.06 * BeatLibrary::RATE * g + 0.5);
+	min_len_ = (int) (0.3 * p_.sample_rate);
+	max_len_ = (int) (2.0 * p_.sample_rate);
+	swing_phase_ = rng_.uniform (0, 2*M_PI);
+	next_episode_ = random_after (0, 0, p_.episodes_per_hour / 3600);
+	next_artifact_ = random_after (0, 0, p_.artifacts_per_min / 60);
+	wander_.init (p_.wander_hz / p_.sample_rate, rng_.uniform (0, 2*M_PI));
+	mains_.init (p_.mains_hz / p_.sample_rate, rng_.uniform (0, 2*M_PI));
+	for (uint32_t &x : noise_) x = (uint32_t) rng_.next() | 1;
+    }
+
+    // The next n samples (12-bit, like the ADC's). The QRS of every beat
+    // begun so far is appended to 'qrs' (if given) as an absolute sample
+    // number; it can be a little past the n samples.
+    void generate (int *out, size_t n, std::vector<uint64_t> *qrs = nullptr) {
+	while (n > 0) {
+	    if (used_ == BLOCK)
+		refill();
+	    size_t m = std::min (n, (size_t) (BLOCK - used_));
+	    std::copy (&block_[used_], &block_[used_] + m, out);
+	    used_ += m;  out += m;  n -= m;
+	}
+	if (qrs != nullptr)
+	    qrs->insert (qrs->end(), qrs_.begin(), qrs_.end());
+	qrs_.clear();
+    }
+
+  private:
+    enum ArtifactKind { MOTION, MUSCLE, LEAD_OFF };
+
+    // The output is made a block at a time, in passes that each do one thing
+    // over the whole block, and the per-sample parts are done LANES samples
+    // at a time so that they vectorize.
+    static const int BLOCK = 512, LANES = 8;
+
+    // e^(i*phase) at LANES consecutive samples, advanced LANES samples at a
+    // time.
+    struct Phasors {
+	double re[LANES], im[LANES], c, s;
+	void init (double cycles_per_sample, double phase) {
+	    for (int k=0; k<LANES; ++k) {
+		re[k] = cos (phase + 2*M_PI*cycles_per_sample*k);
+		im[k] = sin (phase + 2*M_PI*cycles_per_sample*k);
+	    }
+	    c = cos (2*M_PI*cycles_per_sample*LANES);
+	    s = sin (2*M_PI*cycles_per_sample*LANES);
+	}
+	void rotate () {
+	    for (int k=0; k<LANES; ++k) {
+		double r = re[k]*c - im[k]*s;
+		im[k] = re[k]*s + im[k]*c;
+		re[k] = r;
+	    }
+	}
+	void normalize () {	// Now and then, so that rounding can't add up.
+	    for (int k=0; k<LANES; ++k) {
+		double m = 1.0 / sqrt (re[k]*re[k] + im[k]*im[k]);
+		re[k] *= m;  im[k] *= m;
+	    }
+	}
+    };
+
+    static uint32_t xorshift (uint32_t x) {
+	x ^= x << 13;  x ^= x >> 17;  x ^= x << 5;
+	return (x);
+    }
+
+    // The sample 'seconds' after sample 'from'.
+    uint64_t sample_at (uint64_t from, double seconds) const {
+	return (from + (uint64_t) (seconds * p_.sample_rate) + 1);
+    }
+
+    // When the next of some random events (a Poisson process, 'per_sec' on
+    // average) is due, if it can't start until 'secs' after 'from'; or never.
+    uint64_t random_after (uint64_t from, double secs, double per_sec) {
+	if (per_sec <= 0)
+	    return (UINT64_MAX);
+	return (sample_at (from, secs + rng_.exponential (1 / per_sec)));
+    }
+
+    // The next BLOCK samples.
+    void refill () {
+	// Wander, hum and noise.
+	double bg[BLOCK];
+	const double noise_scale = p_.noise / 0x8000;
+	for (int b=0; b<BLOCK; b+=LANES) {
+	    for (int k=0; k<LANES; ++k) {
+		bg[b+k] = p_.baseline + p_.wander*wander_.im[k]
+			+ p_.mains*mains_.im[k]
+			+ noise_scale * ((int)(noise_[k] & 0xFFFF) - 0x8000);
+		noise_[k] = xorshift (noise_[k]);
+	    }
+	    wander_.rotate();
+	    mains_.rotate();
+	}
+
+	// The beats.
+	for (int b=0; b<BLOCK; ) {
+	    if (pos_ == cycle_.size()) {
+		next_cycle (t_ + b);
+		qrs_.push_back (t_ + b + cycle_qrs_);
+	    }
+	    int m = std::min (BLOCK - b, (int) (cycle_.size() - pos_));
+	    for (int k=0; k<m; ++k)
+		bg[b+k] += cycle_[pos_+k];
+	    pos_ += m;  b += m;
+	}
+
+	// Artifacts, over whatever part of the block they cover.
+	uint64_t end = t_ + BLOCK;
+	for (uint64_t t=t_; t<end; ) {
+	    if (art_left_ == 0) {
+		if (next_artifact_ >= end)
+		    break;
+		t = next_artifact_;
+		start_artifact (t);
+	    }
+	    int from = (int) (t - t_);
+	    int m = (int) std::min<uint64_t> (art_left_, end - t);
+	    for (int k=from; k<from+m; ++k)
+		switch (art_kind_) {
+		  case MOTION:	bg[k] += art_level_;  art_level_ *= art_decay_;
+				break;
+		  case MUSCLE:	art_noise_ = xorshift (art_noise_);
+				bg[k] += art_level_ * ((int)(art_noise_ & 0xFF)
+						       - 0x80) * (1.0/0x80);
+				break;
+		  case LEAD_OFF: bg[k] = art_level_;  break;
+		}
+	    art_left_ -= m;  t += m;
+	}
+
+	for (int k=0; k<BLOCK; ++k)
+	    block_[k] = std::min (4095, std::max (0, (int) bg[k]));
+	t_ = end;
+	used_ = 0;
+    }
+
+    // Pick the beat that starts at sample 'now' and its interval, and warp
+    // it into cycle_.
+    void next_cycle (uint64_t now) {
+	double t = (double)now / p_.sample_rate;
+	if (now >= next_episode_) {
+	    if (episode_bpm_ == 0) {
+		episode_bpm_ = p_.bpm * rng_.uniform (-0.3, 0.6);
+		next_episode_ = sample_at (now, rng_.uniform (30, 180));
+	    } else {
+		episode_bpm_ = 0;
+		next_episode_ = random_after (now, 0,
+					      p_.episodes_per_hour / 3600);
+	    }
+	}
+	double bpm = p_.bpm + episode_bpm_
+		   + p_.swing_bpm * sin (2*M_PI*t/p_.swing_period_s
+					 + swing_phase_);
+	double rr = 60.0 / std::max (bpm, 20.0)
+		  * (1.0 + p_.jitter * rng_.gaussian());
+	int len = std::min (max_len_, std::max (min_len_,
+			    (int) (rr * p_.sample_rate + 0.5)));
+
+	const BeatTemplate &b = (*beats_)[rng_.next() % beats_->size()];
+	warp (b, len, (float) (p_.beat_gain * rng_.uniform (0.9, 1.1)));
+	pos_ = 0;
+	wander_.normalize();
+	mains_.normalize();
+    }
+
+    // Stretch b to 'len' samples: the QRS (qrs_half_ either side) only
+    // follows the sample rate, and the rest of the cycle is scaled to fit.
+    void warp (const BeatTemplate &b, int len, float gain) {
+	double g = p_.sample_rate / (double)BeatLibrary::RATE;
+	int src_len = (int) b.x.size() - 1;
+	double src_half = qrs_half_ / g;
+	double left = b.qrs - src_half, right = src_len - b.qrs - src_half;
+	double s = std::max (len - 2.0*qrs_half_, 1.0) / (left + right);
+	int qrs_start = (int) (left * s + 0.5);
+	cycle_qrs_ = qrs_start + qrs_half_;
+
+	// Each part of the output is a straight stretch of the source, so src
+	// just steps along. (b.x has a 0 past the end to interpolate toward.)
+	cycle_.resize (len);
+	float *out = cycle_.data();
+	auto stretch = [&b, out, gain] (int from, int to, double src,
+					double step) {
+	    for (int o=from; o<to; ++o, src+=step) {
+		int i = (int) src;
+		float frac = (float) (src - i);
+		out[o] = gain * (b.x[i] + frac * (b.x[i+1] - b.x[i]));
+	    }
+	};
+	int qrs_end = std::min (len, qrs_start + 2*qrs_half_);
+	stretch (0, qrs_start, 0, 1/s);
+	stretch (qrs_start, qrs_end, left, 1/g);
+	// Aim a hair short, so that rounding can't step past the end.
+	stretch (qrs_end, len, left + 2*src_half,
+		 (right - 1e-6) / std::max (len - qrs_end, 1));
+    }
+
+    // An artifact starts at sample 'now'.
+    void start_artifact (uint64_t now) {
+	art_kind_ = (ArtifactKind) (rng_.next() % 3);
+	double secs = 0;
+	switch (art_kind_) {
+	  case MOTION:
+	    art_level_ = p_.artifact_size * rng_.uniform (-1, 1);
+	    art_decay_ = exp (-1.0 / (rng_.uniform (0.2, 1.0) * p_.sample_rate));
+	    secs = 4;
+	    break;
+	  case MUSCLE:
+	    art_level_ = p_.artifact_size * rng_.uniform (0.05, 0.3);
+	    secs = rng_.uniform (0.2, 2);
+	    break;
+	  case LEAD_OFF:
+	    art_level_ = (rng_.next() & 1) ? 4095 : 0;
+	    secs = rng_.uniform (0.1, 1);
+	    break;
+	}
+	art_left_ = std::max<uint64_t> (1, (uint64_t) (secs * p_.sample_rate));
+	next_artifact_ = random_after (now, secs, p_.artifacts_per_min / 60);
+    }
+
+    SynthParams p_;
+    Rng rng_;
+    const std::vector<BeatTemplate> *beats_;
+    int qrs_half_, min_len_, max_len_;
+
+    uint64_t t_ = 0;		// Samples made so far (the next block's first).
+    int block_[BLOCK];		// The current block,
+    int used_ = BLOCK;		// ... and how much of it generate() has used.
+    std::vector<uint64_t> qrs_;	// Not handed out yet.
+
+    std::vector<float> cycle_;	// The current beat, warped,
+    size_t pos_ = 0;		// ... where we are in it,
+    int cycle_qrs_ = 0;		// ... and where its QRS is.
+    double swing_phase_;
+    double episode_bpm_ = 0;
+    uint64_t next_episode_;
+
+    Phasors wander_, mains_;
+    uint32_t noise_[LANES];
+
+    ArtifactKind art_kind_ = MOTION;
+    uint64_t next_artifact_, art_left_ = 0;
+    double art_level_ = 0, art_decay_ = 1;
+    uint32_t art_noise_ = 2463534242u;
+};
+
+} // namespace ptc_host
+
+#endif // HOST_SYNTH_ECG_HPP
@@ -0,0 +1,87 @@
+// A small fixed-size thread pool for the host tools. Jobs are plain
+// std::function<void()>s pulled from one shared FIFO; wait() blocks until
+// every job submitted so far has finished.
+
+#ifndef HOST_THREAD_POOL_HPP
+#define HOST_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ptc_host {
+
+class ThreadPool {
+  public:
+    // n_threads<=0 means one per hardware thread.
+    explicit ThreadPool (int n_threads=0) {
+	if (n_threads <= 0)
+	    n_threads = std::max (1u, std::thread::hardware_concurrency());
+	for (int i=0; i<n_threads; ++i)
+	    workers_.emplace_back ([this] { work(); });
+    }
+
+    ~ThreadPool () {
+	{
+	    std::lock_guard<std::mutex> lock (mutex_);
+	    stopping_ = true;
+	}
+	job_ready_.notify_all();
+	for (std::thread &t : workers_)
+	    t.join();
+    }
+
+    ThreadPool (const ThreadPool &) = delete;
+    ThreadPool &operator= (const ThreadPool &) = delete;
+
+    int size () const { return ((int) workers_.size()); }
+
+    void submit (std::function<void()> job) {
+	{
+	    std::lock_guard<std::mutex> lock (mutex_);
+	    jobs_.push_back (std::move (job));
+	    ++n_pending_;
+	}
+	job_ready_.notify_one();
+    }
+
+    void wait () {
+	std::unique_lock<std::mutex> lock (mutex_);
+	all_done_.wait (lock, [this] { return (n_pending_ == 0); });
+    }
+
+  private:
+    void work () {
+	for (;;) {
+	    std::function<void()> job;
+	    {
+		std::unique_lock<std::mutex> lock (mutex_);
+		job_ready_.wait (lock, [this] {
+		    return (stopping_ || !jobs_.empty()); });
+		if (jobs_.empty())
+		    return;		// Stopping, and nothing left to do.
+		job = std::move (jobs_.front());
+		jobs_.pop_front();
+	    }
+	    job();
+	    std::lock_guard<std::mutex> lock (mutex_);
+	    if (--n_pending_ == 0)
+		all_done_.notify_all();
+	}
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable job_ready_, all_done_;
+    long n_pending_ = 0;	// Submitted but not yet finished.
+    bool stopping_ = false;
+};
+
+} // namespace ptc_host
+
+#endif // HOST_THREAD_POOL_HPP
@@ -0,0 +1,149 @@
+// The binary trace format (.ptct) that the host tools write and
+// lab7_host_plot.py reads; it replaces the whitespace-separated text dumps
+// for anything big. Everything is little-endian:
+//	offset 0   char[8]   magic "PTCTRACE"
+//	       8   uint32    version (1)
+//	      12   uint32    n_signals
+//	      16   uint64    n_samples: how many samples each signal has
+//	      24   uint64    stride: samples reserved per column (>= n_samples)
+//	      32   uint32    sample_rate, in Hz (0 if unknown)
+//	      36   uint32    data_offset: where the columns start
+//	      40   char[32]  signal names, NUL-padded, one per signal
+//	  data_offset        the columns: signal s is n_samples int32's at
+//			     data_offset + s*stride*4
+// So each signal is one contiguous array, and a reader can map the file and
+// use the columns in place (numpy.memmap does exactly that). data_offset is a
+// multiple of 64.
+// The writer needs to know (an upper bound on) the number of samples when it
+// opens the file, so that it can place the columns; it buffers a block of
+// every column and writes each block straight to its place.
+
+#ifndef HOST_TRACE_FILE_HPP
+#define HOST_TRACE_FILE_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace ptc_host {
+
+static const char TRACE_MAGIC[8] = { 'P','T','C','T','R','A','C','E' };
+static const uint32_t TRACE_VERSION = 1;
+static const int TRACE_NAME_LEN = 32;
+
+class TraceWriter {
+  public:
+    TraceWriter () = default;
+    ~TraceWriter () { close(); }
+    TraceWriter (const TraceWriter &) = delete;
+    TraceWriter &operator= (const TraceWriter &) = delete;
+
+    // Create 'filename' for the given signals, with room for up to 'stride'
+    // samples of each. Returns false if the file can't be created or a name
+    // is too long.
+    bool open (const std::string &filename,
+	       const std::vector<std::string> &names, uint64_t stride,
+	       uint32_t sample_rate) {
+	close();
+	n_signals_ = names.size();
+	stride_ = stride;
+	n_samples_ = n_flushed_ = 0;
+	header_.assign (40 + TRACE_NAME_LEN*n_signals_, 0);
+	data_offset_ = (header_.size() + 63) / 64 * 64;
+
+	memcpy (&header_[0], TRACE_MAGIC, 8);
+	put32 (8, TRACE_VERSION);
+	put32 (12, (uint32_t) n_signals_);
+	put64 (24, stride_);
+	put32 (32, sample_rate);
+	put32 (36, (uint32_t) data_offset_);
+	for (size_t s=0; s<n_signals_; ++s) {
+	    if (names[s].size() >= TRACE_NAME_LEN)
+		return (false);
+	    memcpy (&header_[40 + TRACE_NAME_LEN*s], names[s].data(),
+		    names[s].size());
+	}
+
+	fp_ = fopen (filename.c_str(), "wb");
+	if (fp_ == nullptr)
+	    return (false);
+	ok_ = true;
+	block_.assign (n_signals_ * BLOCK, 0);
+	write_at (0, header_.data(), header_.size());
+	return (ok_);
+    }
+
+    // Append one sample of every signal; row[s] is signal s. Returns false
+    // once the file is full or a write has failed.
+    bool write (const int32_t *row) {
+	if (!ok_ || (n_samples_ == stride_))
+	    return (false);
+	size_t i = n_samples_ - n_flushed_;
+	for (size_t s=0; s<n_signals_; ++s)
+	    block_[s*BLOCK + i] = row[s];
+	if (++n_samples_ - n_flushed_ == BLOCK)
+	    flush();
+	return (ok_);
+    }
+
+    // Write the rest, fill in n_samples and close. Returns false if any
+    // write failed along the way.
+    bool close () {
+	if (fp_ == nullptr)
+	    return (false);
+	flush();
+	// Extend the file to its full size, so that a reader can always map
+	// all 'stride' samples of the last column.
+	if (stride_ > n_samples_) {
+	    int32_t zero = 0;
+	    write_at (data_offset_ + (n_signals_*stride_ - 1) * 4, &zero, 4);
+	}
+	put64 (16, n_samples_);
+	write_at (16, &header_[16], 8);
+	ok_ &= (fclose (fp_) == 0);
+	fp_ = nullptr;
+	return (ok_);
+    }
+
+    uint64_t n_samples () const { return (n_samples_); }
+
+  private:
+    static const size_t BLOCK = 4096;	// Samples buffered per column.
+
+    void put32 (size_t at, uint32_t v) {
+	for (int i=0; i<4; ++i) header_[at+i] = (uint8_t)(v >> (8*i));
+    }
+    void put64 (size_t at, uint64_t v) {
+	for (int i=0; i<8; ++i) header_[at+i] = (uint8_t)(v >> (8*i));
+    }
+
+    void write_at (uint64_t offset, const void *data, size_t n_bytes) {
+	ok_ = ok_ && (fseeko (fp_, (off_t) offset, SEEK_SET) == 0)
+	      && (fwrite (data, 1, n_bytes, fp_) == n_bytes);
+    }
+
+    // Write the buffered part of each column to its place in the file.
+    // (We assume a little-endian host, as the format does.)
+    void flush () {
+	size_t n = n_samples_ - n_flushed_;
+	if (n == 0)
+	    return;
+	for (size_t s=0; s<n_signals_; ++s)
+	    write_at (data_offset_ + (s*stride_ + n_flushed_) * 4,
+		      &block_[s*BLOCK], n*4);
+	n_flushed_ = n_samples_;
+    }
+
+    FILE *fp_ = nullptr;
+    bool ok_ = false;
+    size_t n_signals_ = 0;
+    uint64_t stride_ = 0, n_samples_ = 0, n_flushed_ = 0, data_offset_ = 0;
+    std::vector<uint8_t> header_;
+    std::vector<int32_t> block_;	// BLOCK samples of each column.
+};
+
+} // namespace ptc_host
+
+#endif // HOST_TRACE_FILE_HPP
@@ -0,0 +1,178 @@
+// A work-stealing thread pool for the host tools, for lots of small jobs
+// (see lab7_host_serve). Each worker has its own deque: it takes its own
+// jobs from the back, and when it runs out, it steals from the front of the
+// others'. Jobs submitted from outside are dealt round-robin across the
+// deques; jobs submitted by a job go on its own worker's deque. Each deque
+// has its own lock, so workers only contend when they steal.
+// A job gets the index of the worker running it, so that it can keep
+// per-worker statistics without any locking.
+
+#ifndef HOST_WORK_STEALING_POOL_HPP
+#define HOST_WORK_STEALING_POOL_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ptc_host {
+
+class WorkStealingPool {
+  public:
+    using Job = std::function<void (int worker)>;
+
+    // n_threads<=0 means one per hardware thread.
+    explicit WorkStealingPool (int n_threads=0) {
+	if (n_threads <= 0)
+	    n_threads = std::max (1u, std::thread::hardware_concurrency());
+	for (int i=0; i<n_threads; ++i)
+	    queues_.emplace_back (new Queue);
+	for (int i=0; i<n_threads; ++i)
+	    threads_.emplace_back ([this, i] { work (i); });
+    }
+
+    ~WorkStealingPool () {
+	{
+	    std::lock_guard<std::mutex> lock (sleep_mutex_);
+	    stop_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread &t : threads_) t.join();
+    }
+
+    WorkStealingPool (const WorkStealingPool &) = delete;
+    WorkStealingPool &operator= (const WorkStealingPool &) = delete;
+
+    void submit (Job job) {
+	std::vector<Job> one;
+	one.push_back (std::move (job));
+	submit (one);
+    }
+
+    // Submit a batch at once, with one wake-up for the lot.
+    void submit (std::vector<Job> &jobs) {
+	if (jobs.empty())
+	    return;
+	pending_ += jobs.size();
+	int me = current_worker();
+	for (Job &job : jobs) {
+	    Queue &q = *queues_[(me >= 0) ? me : next_queue()];
+	    std::lock_guard<std::mutex> lock (q.mutex);
+	    q.jobs.push_back (std::move (job));
+	}
+	{
+	    std::lock_guard<std::mutex> lock (sleep_mutex_);
+	    queued_ += jobs.size();
+	}
+	if (jobs.size() == 1) wake_.notify_one(); else wake_.notify_all();
+	jobs.clear();
+    }
+
+    // Block until every job submitted so far has finished.
+    void wait () {
+	std::unique_lock<std::mutex> lock (sleep_mutex_);
+	done_.wait (lock, [this] { return (pending_ == 0); });
+    }
+
+    int size () const { return ((int) threads_.size()); }
+
+    // How many jobs were stolen so far.
+    uint64_t n_steals () const { return (steals_); }
+
+  private:
+    struct Queue {
+	std::mutex mutex;
+	std::deque<Job> jobs;
+    };
+
+    // Which worker this thread is (or -1 if it isn't one of ours).
+    int current_worker () const {
+	return ((tls_pool() == this) ? tls_index() : -1);
+    }
+    static const WorkStealingPool *&tls_pool () {
+	static thread_local const WorkStealingPool *pool = nullptr;
+	return (pool);
+    }
+    static int &tls_index () {
+	static thread_local int index = -1;
+	return (index);
+    }
+
+    size_t next_queue () {
+	return (deal_.fetch_add (1, std::memory_order_relaxed)
+		% queues_.size());
+    }
+
+    bool pop (int me, Job &job) {
+	Queue &q = *queues_[me];
+	std::lock_guard<std::mutex> lock (q.mutex);
+	if (q.jobs.empty())
+	    return (false);
+	job = std::move (q.jobs.back());
+	q.jobs.pop_back();
+	return (true);
+    }
+
+    bool steal (int me, uint32_t &rng, Job &job) {
+	int n = (int) queues_.size();
+	rng ^= rng << 13;  rng ^= rng >> 17;  rng ^= rng << 5;
+	for (int i=0, v=(int)(rng % n); i<n; ++i, v=(v+1)%n) {
+	    if (v == me)
+		continue;
+	    Queue &q = *queues_[v];
+	    std::lock_guard<std::mutex> lock (q.mutex);
+	    if (q.jobs.empty())
+		continue;
+	    job = std::move (q.jobs.front());
+	    q.jobs.pop_front();
+	    ++steals_;
+	    return (true);
+	}
+	return (false);
+    }
+
+    void work (int me) {
+	tls_pool() = this;
+	tls_index() = me;
+	uint32_t rng = 2463534242u + 7919u*me;
+	Job job;
+	for (;;) {
+	    if (pop (me, job) || steal (me, rng, job)) {
+		--queued_;
+		job (me);
+		job = nullptr;
+		if (--pending_ == 0) {
+		    std::lock_guard<std::mutex> lock (sleep_mutex_);
+		    done_.notify_all();
+		}
+		continue;
+	    }
+	    // Nothing anywhere: sleep until something is queued. (queued_ is
+	    // only raised under sleep_mutex_, so we can't miss it.)
+	    std::unique_lock<std::mutex> lock (sleep_mutex_);
+	    wake_.wait (lock, [this] { return (stop_ || (queued_ > 0)); });
+	    if (stop_)
+		return;
+	}
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_, done_;
+    std::atomic<size_t> queued_ {0};	// In the deques.
+    std::atomic<size_t> pending_ {0};	// Submitted and not finished.
+    std::atomic<size_t> deal_ {0};
+    std::atomic<uint64_t> steals_ {0};
+    bool stop_ = false;
+};
+
+} // namespace ptc_host
+
+#endif // HOST_WORK_STEALING_POOL_HPP
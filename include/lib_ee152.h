@@ -22,6 +22,15 @@ void clock_setup_80MHz(void);		// 80 MHz, AHB and APH1/2 prescale=1x
 // Spin-loop time delay
 void delay(unsigned long ms);	// From the Arduino API.
 
+// Start the Cortex-M4's DWT cycle counter, which counts HCLK cycles (so it
+// wraps every 53s at 80 MHz), and read it.
+void cycle_counter_start (void);
+static inline uint32_t cycle_count (void) { return (DWT->CYCCNT); }
+
+// Set TIM6 or TIM7 up (but don't start it) to send a TRGO pulse rate_hz
+// times a second, to pace the ADC or DAC in hardware.
+void basic_timer_init (TIM_TypeDef *tim, uint32_t rate_hz);
+
 /////////////////////////////////////////////
 // Analog and digital writing/reading, straight from the Arduino API.
 /////////////////////////////////////////////
@@ -51,6 +60,13 @@ uint32_t analogRead(enum Pin pin);
 void ADC_Init(void);	// Sets up ADC1 channel 5, which is PA0 (Nano A0).
 uint32_t ADC1_read (void);	// 12-bit read of whichever channel is set up.
 
+// Hardware-paced acquisition: TIM6 triggers a conversion every 1/rate_hz
+// seconds, and DMA fills buf[n] circularly; DMA1_Channel1_IRQHandler() (which
+// you supply) gets the half-transfer and transfer-complete interrupts, i.e.,
+// one per n/2-sample block. See lib_ADC.c.
+void ADC1_start_dma (uint16_t *buf, uint32_t n, uint32_t rate_hz,
+		     uint32_t priority);
+
 //**********************************
 // DAC
 //**********************************
@@ -72,12 +88,17 @@ void DAC1_write (uint32_t data);
 // Write 12-bit unsigned data to DAC 2, which drives pin PA5, a.k.a., Nano A4
 void DAC2_write (uint32_t data);
 
+// Loop 12-bit buf[n] out of DAC 1 at rate_hz, paced by TIM7 and fed by DMA,
+// with no CPU involvement once it's started.
+void DAC1_start_dma (const uint16_t *buf, uint32_t n, uint32_t rate_hz);
+
 //**********************************
 // UART
 //**********************************
 
-// Initialization.
+// Initialization, at 9600 baud (serial_begin) or any rate up to 5 Mbaud.
 void serial_begin (USART_TypeDef *USARTx);
+void serial_begin_baud (USART_TypeDef *USARTx, int baud);
 
 // Very basic function: send a character string to the UART, one byte at a time.
 // Spin wait after each byte until the UART is ready for the next byte.
@@ -85,3 +106,26 @@ void serial_write (USART_TypeDef *USARTx, const char *buffer);
 
 // Spin wait until we have a byte.
 char serial_read (USART_TypeDef *USARTx);
+
+// Non-blocking transmit, for USART1 and USART2. serial_begin_nb() sets the
+// UART up at 'baud' with a 1KB transmit ring that DMA drains in the
+// background; its DMA interrupt runs at NVIC priority 'priority'.
+// serial_write_nb() queues data[n] and returns at once; it's all or nothing,
+// returning false (and counting the bytes in serial_tx_dropped()) if there
+// isn't room for all of it. The 'done' callback, if set, runs from the DMA
+// interrupt whenever the ring has emptied (the last byte or two may still be
+// on the wire). serial_write() still works on such a UART; it goes through
+// the ring and waits for it to drain.
+void serial_begin_nb (USART_TypeDef *USARTx, int baud, uint32_t priority);
+bool serial_write_nb (USART_TypeDef *USARTx, const void *data, uint32_t n);
+void serial_on_tx_done (USART_TypeDef *USARTx, void (*done) (void *arg),
+			void *arg);
+bool serial_tx_busy (USART_TypeDef *USARTx);	// Anything still queued?
+uint32_t serial_tx_free (USART_TypeDef *USARTx);	// Room in the ring, in bytes
+uint32_t serial_tx_dropped (USART_TypeDef *USARTx);
+
+// Interrupt-driven receive: call rx(arg, byte), from the UART's interrupt at
+// NVIC priority 'priority', for each byte that comes in. (Only for a UART
+// whose receiver is on; of ours, that's USART2.)
+void serial_on_rx (USART_TypeDef *USARTx, void (*rx) (void *arg, uint8_t byte),
+		   void *arg, uint32_t priority);
@@ -0,0 +1,86 @@
+//****************************************************
+// A memory report: how close each task's stack has come to overflowing, how
+// busy each block pool (lib_pool.h) is, and how full and how fragmented the
+// heap is, if there is one. The board fills one in from the kernel
+// (uxTaskGetStackHighWaterMark(), vPortGetHeapStats()) every few seconds
+// and sends it as a telemetry report (lib_telemetry.h); the host's
+// simulation of the main loop (lab7_host_acquire) fills one in from its own
+// run. Either way lab7_host_telemetry or the tool itself prints it.
+// Like lib_sample_clock.c, nothing in here touches the hardware.
+//****************************************************
+
+#ifndef LIB_MEMORY_H
+#define LIB_MEMORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTC_MEM_MAX_TASKS	8
+#define PTC_MEM_NAME_LEN	8	// Task names are cut to this.
+#define PTC_MEM_MAX_POOLS	2
+
+struct ptc_mem_task {
+    uint32_t number;			// The kernel's task number.
+    char name[PTC_MEM_NAME_LEN + 1];
+    uint32_t stack_words;		// As created...
+    uint32_t stack_min_free_words;	// ...and the least left unused so far.
+};
+
+// All in bytes, but the counts. The free space is the sum of the free
+// blocks; the largest of them is the biggest allocation that could succeed,
+// so the gap between the two is what fragmentation costs.
+struct ptc_mem_heap {
+    uint32_t total, free, min_free;
+    uint32_t largest_free, smallest_free, n_free_blocks;
+    uint32_t n_allocs, n_frees;
+};
+
+// A block pool's stats; n_blocks - n_free are in use.
+struct ptc_mem_pool {
+    uint32_t block_size, n_blocks;
+    uint32_t n_free, min_free;
+    uint32_t n_allocs, n_failed;
+};
+
+struct ptc_mem_report {
+    uint32_t n_tasks;
+    struct ptc_mem_task tasks[PTC_MEM_MAX_TASKS];
+    bool have_heap;			// No heap, e.g., all static.
+    struct ptc_mem_heap heap;
+    uint32_t n_pools;
+    struct ptc_mem_pool pools[PTC_MEM_MAX_POOLS];
+};
+
+// As words for a telemetry report: n_tasks, have_heap, the heap in order,
+// n_pools, each pool in order, then per task its number, stack_words,
+// stack_min_free_words and name (as 2 words, little-endian, NUL-padded).
+// to_words() returns the number of words; from_words() returns false if
+// they don't make sense.
+#define PTC_MEM_HEAP_WORDS	8
+#define PTC_MEM_POOL_WORDS	6
+#define PTC_MEM_TASK_WORDS	(3 + PTC_MEM_NAME_LEN/4)
+#define PTC_MEM_MAX_WORDS	(3 + PTC_MEM_HEAP_WORDS			\
+				 + PTC_MEM_POOL_WORDS*PTC_MEM_MAX_POOLS	\
+				 + PTC_MEM_TASK_WORDS*PTC_MEM_MAX_TASKS)
+uint32_t ptc_mem_to_words (const struct ptc_mem_report *r, uint32_t *words);
+bool ptc_mem_from_words (const uint32_t *words, uint32_t n_words,
+			 struct ptc_mem_report *r);
+
+// Add a task to r, cutting its name; false if r is full.
+bool ptc_mem_add_task (struct ptc_mem_report *r, uint32_t number,
+		       const char *name, uint32_t stack_words,
+		       uint32_t stack_min_free_words);
+
+// Add a pool's stats to r; false if r is full.
+bool ptc_mem_add_pool (struct ptc_mem_report *r, const struct ptc_pool *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_MEMORY_H
@@ -0,0 +1,58 @@
+//****************************************************
+// A pool of fixed-size blocks: allocating and freeing are O(1) (the free
+// blocks are a list threaded through the blocks themselves), so they take
+// the same few cycles every time and can't fragment, and they're safe from
+// ISRs as well as tasks. The storage is the caller's, normally a static
+// array, so the linker map still shows it. Each pool keeps its usage stats,
+// which the memory report (lib_memory.h) carries.
+// On the board a block is taken and freed with interrupts off (for a dozen
+// cycles or so); on the host, under a spin lock, so threads can share a pool.
+// Otherwise nothing in here touches the hardware.
+//****************************************************
+
+#ifndef LIB_POOL_H
+#define LIB_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ptc_pool {
+    uint8_t *blocks;
+    uint32_t block_size;	// Rounded up to a multiple of sizeof (void *).
+    uint32_t n_blocks;
+    void *free_list;
+    volatile uint8_t lock;	// Only on the host.
+    uint32_t n_free;
+    uint32_t min_free;		// The fewest free there have ever been.
+    uint32_t n_allocs, n_frees;
+    uint32_t n_failed;		// Allocations when there was nothing free.
+};
+
+// The storage for n blocks of 'size' bytes, as a number of pointers; declare
+// it as void *name[PTC_POOL_PTRS (size, n)], so that each block is aligned
+// for the free list's link (which is 8 bytes on the 64-bit host).
+#define PTC_POOL_BLOCK_PTRS(size) \
+	(((size) + sizeof (void *) - 1) / sizeof (void *))
+#define PTC_POOL_PTRS(size, n)	(PTC_POOL_BLOCK_PTRS (size) * (n))
+
+// Set 'p' up over storage[PTC_POOL_PTRS (block_size, n_blocks)], with
+// every block free. Returns false if there are no blocks, or they're empty.
+bool ptc_pool_init (struct ptc_pool *p, void **storage,
+		    uint32_t block_size, uint32_t n_blocks);
+
+// A block, or NULL (counted in n_failed) if they're all in use.
+void *ptc_pool_alloc (struct ptc_pool *p);
+
+// Give a block back. Returns false, and does nothing, if 'block' isn't one of
+// the pool's.
+bool ptc_pool_free (struct ptc_pool *p, void *block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_POOL_H
@@ -0,0 +1,147 @@
+//****************************************************
+// A per-stage profiler for the main loop: how long each stage of the
+// pipeline takes, in counts of a free-running counter, kept as min, max,
+// total and a histogram. On the board the counter is the DWT cycle counter
+// (start it with cycle_counter_start()); on the host it's the TSC (rdtsc)
+// on x86, and clock_gettime() in ns elsewhere. ptc_prof_counts_per_us()
+// says how fast it runs, so that the numbers from both can be compared in
+// time. (The TSC counts at its own fixed rate, not the core's clock.)
+//
+// The stages nest: the pipeline's own (LOWPASS to THRESH_2) are inside
+// PIPELINE, and that's inside BLOCK, along with ACQUIRE and OUTPUT. Recording
+// an inner stage takes time that the outer one would count; so a loop that
+// times its blocks calls PTC_PROF_NEXT_LEVEL() after each, and the levels
+// take turns, one per block, each being timed only while the others aren't.
+// (Until then, every stage is timed, nesting and all, which is fine when
+// there's only one level, as in a bare run of the pipeline.) Each stage
+// still includes one read of the counter: a cycle on the board, but a
+// rdtsc, some 20ns, on the host.
+//
+// The PTC_PROF_* macros do nothing unless PTC_PROFILE is defined, so they
+// can stay in the code. Recording is a few dozen cycles, done by whoever
+// times the stage, with no locking; so profile single-threaded builds (the
+// board, lab7_host_acquire), not the host's thread pools.
+//****************************************************
+
+#ifndef LIB_PROFILE_H
+#define LIB_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__arm__)
+#include "stm32l432xx.h"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ptc_prof_stage {
+    PTC_PROF_ACQUIRE,	// Taking a block from the sample ring.
+    PTC_PROF_LOWPASS,	// The biquad cascade.
+    PTC_PROF_PEAK_1,	// Left side: peak finder...
+    PTC_PROF_THRESH_1,	// ...and its threshold.
+    PTC_PROF_DERIV_2,	// Right side: derivative and square...
+    PTC_PROF_WINDOW_2,	// ...window average...
+    PTC_PROF_PEAK_2,	// ...peak finder...
+    PTC_PROF_THRESH_2,	// ...and threshold, with the dual-QRS decision.
+    PTC_PROF_PIPELINE,	// All of the above but ACQUIRE, per sample.
+    PTC_PROF_OUTPUT,	// Telemetry and the DACs, per sample.
+    PTC_PROF_BLOCK,	// A whole block, from the ring to the last output.
+    PTC_PROF_N_STAGES
+};
+
+// Bucket 0 is 0 counts; bucket b (1 <= b < N-1) is [2**(b-1), 2**b); the
+// last is everything from 2**(N-2) up (52ms of cycles at 80 MHz).
+#define PTC_PROF_N_BUCKETS 24
+
+struct ptc_prof_stats {
+    uint32_t n;			// Measurements.
+    uint32_t n_samples;		// Samples they covered.
+    uint32_t min, max;		// Counts.
+    uint64_t sum;
+    uint32_t hist[PTC_PROF_N_BUCKETS];
+};
+
+extern struct ptc_prof_stats ptc_prof[PTC_PROF_N_STAGES];
+
+// The levels, outermost first, as bits; ptc_prof_levels says which of them
+// are being timed.
+#define PTC_PROF_LEVEL_BIT(stage)					\
+	(((stage) == PTC_PROF_BLOCK) ? 1				\
+	 : (((stage) == PTC_PROF_ACQUIRE) || ((stage) == PTC_PROF_PIPELINE) \
+	    || ((stage) == PTC_PROF_OUTPUT)) ? 2 : 4)
+#define PTC_PROF_ALL_LEVELS 7
+extern uint8_t ptc_prof_levels;
+
+// Time the next level in turn, from the next block on.
+void ptc_prof_next_level (void);
+
+static inline uint32_t ptc_prof_now (void) {
+#if defined(__arm__)
+    return (DWT->CYCCNT);
+#elif defined(__x86_64__) || defined(__i386__)
+    return ((uint32_t) __rdtsc ());
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((uint32_t) (ts.tv_sec * 1000000000ull + ts.tv_nsec));
+#endif
+}
+
+// Add a measurement of 'counts', covering n_samples samples, to 'stage'.
+void ptc_prof_record (int stage, uint32_t counts, uint32_t n_samples);
+
+// Forget everything so far.
+void ptc_prof_reset (void);
+
+// How many counts of ptc_prof_now() there are in a microsecond. On the host,
+// the first call measures it, which takes 20ms.
+uint32_t ptc_prof_counts_per_us (void);
+
+// "lowpass" and so on.
+const char *ptc_prof_stage_name (int stage);
+
+// One stage's stats as a flat array of words, for a telemetry report (see
+// lib_telemetry.h): the stage, counts_per_us, then the struct in order, the
+// sum as two words, low first. And back; from_words() returns the stage, or
+// -1 if it isn't one.
+#define PTC_PROF_N_WORDS (8 + PTC_PROF_N_BUCKETS)
+void ptc_prof_to_words (int stage, uint32_t *words);
+int ptc_prof_from_words (const uint32_t *words, uint32_t *counts_per_us,
+			 struct ptc_prof_stats *stats);
+
+// Time a sequence of stages: START once, then LAP after each stage to record
+// it and restart the clock (so the recording isn't counted in the next
+// stage), or END to record the last one as covering n samples. Stages whose
+// level isn't being timed cost only the test of ptc_prof_levels.
+#ifdef PTC_PROFILE
+#define PTC_PROF_START(t)	uint32_t t = ptc_prof_now ()
+#define PTC_PROF_LAP(t, stage)	do {					\
+	if (ptc_prof_levels & PTC_PROF_LEVEL_BIT (stage)) {		\
+	    ptc_prof_record ((stage), ptc_prof_now () - (t), 1);	\
+	    (t) = ptc_prof_now ();					\
+	}								\
+    } while (0)
+#define PTC_PROF_END(t, stage, n) do {					\
+	if (ptc_prof_levels & PTC_PROF_LEVEL_BIT (stage))		\
+	    ptc_prof_record ((stage), ptc_prof_now () - (t), (n));	\
+    } while (0)
+#define PTC_PROF_NEXT_LEVEL()	ptc_prof_next_level ()
+#else
+#define PTC_PROF_START(t)	 do { } while (0)
+#define PTC_PROF_LAP(t, stage)	 do { } while (0)
+#define PTC_PROF_END(t, stage, n) do { } while (0)
+#define PTC_PROF_NEXT_LEVEL()	 do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_PROFILE_H
@@ -0,0 +1,215 @@
+//****************************************************
+// The signal-processing kernels for the Pan-Tompkins-Charles (PTC) algorithm.
+// Nothing in here touches the hardware, so the same code builds both into the
+// board image and into the host-debug programs (src/lab7_host_*.cxx-noop).
+//****************************************************
+
+#ifndef LIB_PTC_H
+#define LIB_PTC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************
+// Biquad filtering.
+//****************************************************
+
+struct biquadcoeffs {	// The coefficients of a single biquad section.
+    float b0, b1, b2,	// numerator
+	  a0, a1, a2;	// denominator
+};
+
+// All DSP filters need state. Note that the state is kept in the normalized
+// [0,1) domain (i.e., sample / 2**n_bits), not in ADC units.
+struct biquadstate { float x_nm1, x_nm2, y_nm1, y_nm2; };
+
+// Our 20Hz lowpass filter (at 500 Hz sampling) is built from two biquad
+// sections. The initializer is a macro so that the C++ pipeline in
+// ptc_pipeline.hpp can use the same numbers as compile-time constants.
+#define N_BIQUAD_SECS 2	// Number of biquad sections in our filter.
+#define BIQUAD_20HZ_LOWPASS_COEFFS {					\
+	{8.59278969e-05f, 1.71855794e-04f, 8.59278969e-05f,		\
+	 1.0f,		-1.77422345e+00f, 7.96197268e-01f},		\
+	{1.0f,	2.0f,	1.0f,						\
+	 1.0f,	-1.84565849e+00f,	9.11174670e-01f}}
+extern const struct biquadcoeffs biquad_20Hz_lowpass[N_BIQUAD_SECS];
+
+// Filter one sample through one biquad section. 'Sample' is an n_bits
+// unsigned integer, and so is the return value.
+int biquad (const struct biquadcoeffs *coeffs, struct biquadstate *state,
+	    uint32_t sample, uint32_t n_bits);
+
+// Block version: run 'n' samples from in[] through all 'n_secs' cascaded
+// sections (coeffs[0] first), writing the results to out[] (which may be the
+// same array as in[]). The samples are converted to float once on the way in
+// and once on the way out; between sections they stay in float. So unlike
+// calling biquad() once per section, there's no truncation to an integer
+// between sections.
+void biquad_cascade (const struct biquadcoeffs *coeffs,
+		     struct biquadstate *state, int n_secs,
+		     const int *in, int *out, int n, uint32_t n_bits);
+
+//****************************************************
+// Fixed-point biquads.
+//****************************************************
+
+// The same biquad cascade in saturating fixed point, for running without the
+// FPU. Samples are Q31 (or Q15) fractions, with BIQUAD_Q_HEADROOM guard bits
+// above the n_bits input so that filter overshoot doesn't saturate. Our poles
+// need |a1| near 2, so the coefficients are stored scaled down by
+// 2**post_shift (post_shift comes from the quantizer). The feedback
+// coefficients are stored negated (i.e., as -a1 and -a2), so that every term
+// of the difference equation is a multiply-accumulate.
+#define BIQUAD_Q_HEADROOM 1
+
+struct biquad_q31_coeffs { int32_t b0, b1, b2, a1, a2; };
+struct biquad_q31_state  { int32_t x_nm1, x_nm2, y_nm1, y_nm2; };
+
+struct biquad_q15_coeffs { int16_t b0, b1, b2, a1, a2; };
+struct biquad_q15_state  { int16_t x_nm1, x_nm2, y_nm1, y_nm2; };
+
+// Quantize 'n_secs' float sections into fixed-point ones. Before quantizing,
+// the gain is rebalanced so that each section but the last has unity DC gain;
+// the overall response is unchanged, but the small numerator coefficients of
+// our first section no longer lose most of their bits. Returns the post_shift
+// to pass to the matching biquad_cascade_qXX(), or -1 if some coefficient is
+// too big to represent.
+int biquad_quantize_q31 (const struct biquadcoeffs *coeffs, int n_secs,
+			 struct biquad_q31_coeffs *out);
+int biquad_quantize_q15 (const struct biquadcoeffs *coeffs, int n_secs,
+			 struct biquad_q15_coeffs *out);
+
+// Fixed-point versions of biquad_cascade(), with the same in/out conventions.
+// Products are accumulated exactly in 64 bits and rounded once per section
+// output, which is saturated to the sample width. Since it's all integer math,
+// the results are bit-identical on the board and on the host. The input must
+// fit in n_bits+BIQUAD_Q_HEADROOM bits, so Q15 handles at most n_bits=13.
+void biquad_cascade_q31 (const struct biquad_q31_coeffs *coeffs,
+			 struct biquad_q31_state *state, int n_secs,
+			 int post_shift, const int *in, int *out, int n,
+			 uint32_t n_bits);
+void biquad_cascade_q15 (const struct biquad_q15_coeffs *coeffs,
+			 struct biquad_q15_state *state, int n_secs,
+			 int post_shift, const int *in, int *out, int n,
+			 uint32_t n_bits);
+
+//****************************************************
+// Multi-channel (multi-lead) pipeline.
+//****************************************************
+
+// The whole PTC pipeline (lowpass, left- and right-side analysis, dual-QRS)
+// for up to PTC_MAX_CHANNELS leads that are sampled together. Every stage's
+// state is stored struct-of-arrays, i.e., one array per state variable with
+// one entry per channel, so that each stage updates all channels in one pass
+// (and, on the host, in SIMD registers). The delay lines (derivative history,
+// 200ms window) are rings with a single write pointer shared by all channels,
+// since all channels advance together.
+// Per channel, this computes the same thing as task_main_loop(), using the
+// float biquad cascade.
+#define PTC_MAX_CHANNELS	16
+#define PTC_WINDOW_SIZE		100	// 200ms running average at 500 Hz.
+#define PTC_REFRACTORY_TICKS	100	// 200ms at 500 Hz.
+#define PTC_WARMUP_SAMPLES	250	// Ignore startup artifacts.
+#define PTC_DERIV_TAPS		5	// The 5-point derivative.
+
+struct ptc_multi {
+    int n_ch;		// Channels in use.
+    int n_lanes;	// n_ch rounded up to the SIMD width (<=PTC_MAX_CHANNELS)
+    int sample_count;	// Ticks so far, until the warm-up is done.
+    int deriv_ptr;	// Next slot to write in the derivative rings.
+    int window_ptr;	// Next slot to write in the window ring.
+
+    // Biquad state, per section.
+    float bq_x_nm1[N_BIQUAD_SECS][PTC_MAX_CHANNELS];
+    float bq_x_nm2[N_BIQUAD_SECS][PTC_MAX_CHANNELS];
+    float bq_y_nm1[N_BIQUAD_SECS][PTC_MAX_CHANNELS];
+    float bq_y_nm2[N_BIQUAD_SECS][PTC_MAX_CHANNELS];
+
+    // Derivative histories for the left-side peak finder, the right-side
+    // derivative and the right-side peak finder.
+    int peak1_hist[PTC_DERIV_TAPS][PTC_MAX_CHANNELS];
+    int peak1_prev_deriv[PTC_MAX_CHANNELS];
+    int deriv2_hist[PTC_DERIV_TAPS][PTC_MAX_CHANNELS];
+    int peak2_hist[PTC_DERIV_TAPS][PTC_MAX_CHANNELS];
+    int peak2_prev_deriv[PTC_MAX_CHANNELS];
+
+    // 200ms running average of deriv_sq_2. As on the board, the sum is 32
+    // bits.
+    int window_buf[PTC_WINDOW_SIZE][PTC_MAX_CHANNELS];
+    int32_t window_sum[PTC_MAX_CHANNELS];
+
+    // Moving thresholds for the left & right sides.
+    int thresh1[PTC_MAX_CHANNELS], thresh1_max[PTC_MAX_CHANNELS],
+	thresh1_min[PTC_MAX_CHANNELS];
+    int thresh2[PTC_MAX_CHANNELS], thresh2_max[PTC_MAX_CHANNELS],
+	thresh2_min[PTC_MAX_CHANNELS];
+
+    int refractory_counter[PTC_MAX_CHANNELS];
+    int dual_QRS[PTC_MAX_CHANNELS];
+};
+
+// What one tick produces, per channel. The right-side threshold and dual_QRS
+// only start updating after the warm-up; before that they hold their initial
+// values.
+struct ptc_multi_out {
+    int filtered[PTC_MAX_CHANNELS];
+    int peak_1[PTC_MAX_CHANNELS], thresh_1[PTC_MAX_CHANNELS];
+    int deriv_2[PTC_MAX_CHANNELS], avg_200ms_2[PTC_MAX_CHANNELS];
+    int peak_2[PTC_MAX_CHANNELS], thresh_2[PTC_MAX_CHANNELS];
+    int dual_QRS[PTC_MAX_CHANNELS];
+    int dual_QRS_rise[PTC_MAX_CHANNELS];  // 1 on the tick a new QRS starts.
+};
+
+// Set up for 'n_ch' channels (1..PTC_MAX_CHANNELS). Returns 0 on success,
+// -1 for a bad channel count.
+int ptc_multi_init (struct ptc_multi *p, int n_ch);
+
+// Run one tick: samples[c] is the new 12-bit ADC sample for channel c.
+void ptc_multi_step (struct ptc_multi *p, const int *samples,
+		     struct ptc_multi_out *out);
+
+//****************************************************
+// The board's single-channel pipeline.
+//****************************************************
+
+// This is one instantiation of the compile-time-specialized pipeline in
+// ptc_pipeline.hpp (see ptc_pipeline.cpp), with a C interface so that
+// task_main_loop() can call it.
+#define PTC_BOARD_SAMPLE_RATE 500	// Hz
+
+// Everything the pipeline computes for one sample.
+struct ptc_tick {
+    int filtered;			// Lowpassed sample.
+    int peak_1, thresh_1;		// Left side.
+    int deriv_2, deriv_sq_2, avg_200ms_2, peak_2, thresh_2; // Right side.
+    bool warm;		// False during the warm-up, when the fields below
+			// (and thresh_2) aren't meaningful yet.
+    bool dual_QRS;	// Both sides agree on a QRS (outside refractory).
+    bool dual_QRS_rise;	// ... and it just started on this sample.
+};
+
+// Reset the pipeline to its power-up state. Returns false if the lowpass
+// can't be set up (which would be a coding error).
+bool ptc_board_init (void);
+
+// Push one 12-bit ADC sample through the pipeline.
+void ptc_board_step (int sample, struct ptc_tick *tick);
+
+// Snapshot the pipeline's whole state into buf[size] (e.g., in backup RAM),
+// or carry on from such a snapshot. Size must be ptc_board_state_size().
+// Restoring fails (and changes nothing) if the snapshot isn't from this
+// build's pipeline.
+size_t ptc_board_state_size (void);
+bool ptc_board_save (void *buf, size_t size);
+bool ptc_board_restore (const void *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_PTC_H
@@ -0,0 +1,108 @@
+//****************************************************
+// Deadline bookkeeping for the sample clock. The samples themselves are
+// paced in hardware (TIM6 triggers the ADC; see ADC1_start_dma()), so each
+// block of samples is released at an exactly known time: t_start plus a
+// whole number of block periods. This checks how well the software keeps up
+// with that schedule:
+//	- arrival: how late the DMA interrupt sees each block, relative to its
+//	  release. A block more than a period late means the DMA was already
+//	  refilling that half when we copied it (an overrun).
+//	- completion: how long after its release the main loop has finished
+//	  with each block. The deadline is one period, when the next block
+//	  comes; past that, we're only keeping up by leaning on the ring.
+// Both are kept as histograms of the lateness in us, in powers of two, along
+// with the worst case and the rate actually achieved. Times are in whatever
+// free-running 32-bit counter the caller has (the DWT cycle counter on the
+// board; microseconds on the host); only differences are used, so it can
+// wrap, as long as no two consecutive blocks are more than a wrap apart.
+// Like lib_sample_ring.c, nothing in here touches the hardware.
+//****************************************************
+
+#ifndef LIB_SAMPLE_CLOCK_H
+#define LIB_SAMPLE_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bucket 0 is lateness under 1us; bucket b (1 <= b < N-1) is
+// [2**(b-1), 2**b) us; the last bucket is everything from 2**(N-2) us up
+// (65 ms, i.e., a couple of periods at 16 samples and 500 Hz).
+#define SAMPLE_CLOCK_N_BUCKETS 18
+
+// Only the ISR calls sample_clock_arrived(), and only the main loop calls
+// sample_clock_done(); each side writes only its own fields, so they don't
+// need to lock each other out. Reading the ISR's side for a snapshot does,
+// though (the 64-bit 'elapsed' could tear); see sample_clock_get_stats().
+struct sample_clock {
+    uint32_t period;		// Counts per block.
+    uint32_t block_samples;
+    uint32_t counts_per_us;
+    uint32_t t_start;		// When block 0 started to fill.
+
+    // The ISR side.
+    uint32_t n_arrived;		// Blocks so far.
+    uint32_t n_overruns;	// Blocks that arrived a period or more late.
+    uint32_t max_arrival_late;	// Counts.
+    uint32_t last_arrival;
+    uint64_t elapsed;		// From t_start to last_arrival, in counts.
+    uint32_t arrival_hist[SAMPLE_CLOCK_N_BUCKETS];
+
+    // The main loop side.
+    uint32_t n_checked;		// Blocks finished.
+    uint32_t n_missed;		// ...after their deadline.
+    uint32_t max_done_late;	// Counts.
+    uint32_t done_hist[SAMPLE_CLOCK_N_BUCKETS];
+};
+
+// Blocks of block_samples samples at rate_hz, timed by a counter that ticks
+// counts_per_us times a microsecond. The block period must come out to a
+// whole number of counts (it does for the board's 80 MHz and 2000us sample
+// period); returns false if not.
+bool sample_clock_init (struct sample_clock *sc, uint32_t rate_hz,
+			uint32_t block_samples, uint32_t counts_per_us);
+
+// Call just before starting the hardware sample clock.
+void sample_clock_start (struct sample_clock *sc, uint32_t now);
+
+// From the acquisition ISR, once for each block it takes (so twice, with the
+// same 'now', if it found both DMA halves full).
+void sample_clock_arrived (struct sample_clock *sc, uint32_t now);
+
+// From the main loop when it's finished with a block, where n_through is the
+// number of samples the hardware had delivered up to and including the last
+// one processed. (Samples dropped by the sample ring count too, so the caller
+// adds the ring's n_overflows; that's only approximate after an overflow,
+// which has missed its deadline anyway.)
+void sample_clock_done (struct sample_clock *sc, uint32_t now,
+			uint32_t n_through);
+
+// A snapshot, which must be taken with the ISR held off (inside
+// taskENTER_CRITICAL() on the board). The achieved rate is in mHz (so
+// 500000 is exactly 500 Hz).
+struct sample_clock_stats {
+    uint32_t rate_mhz;
+    uint32_t n_arrived, n_overruns, max_arrival_late_us;
+    uint32_t n_checked, n_missed, max_done_late_us;
+    uint32_t arrival_hist[SAMPLE_CLOCK_N_BUCKETS];
+    uint32_t done_hist[SAMPLE_CLOCK_N_BUCKETS];
+};
+void sample_clock_get_stats (const struct sample_clock *sc,
+			     struct sample_clock_stats *stats);
+
+// The stats as a flat array of words, in the order of the struct, for a
+// telemetry report (see lib_telemetry.h); and back.
+#define SAMPLE_CLOCK_N_WORDS (7 + 2*SAMPLE_CLOCK_N_BUCKETS)
+void sample_clock_stats_to_words (const struct sample_clock_stats *stats,
+				  uint32_t *words);
+void sample_clock_stats_from_words (const uint32_t *words,
+				    struct sample_clock_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_SAMPLE_CLOCK_H
@@ -0,0 +1,66 @@
+//****************************************************
+// A lock-free single-producer, single-consumer ring of 12-bit samples, for
+// handing samples from the acquisition side (the ADC interrupt on the board,
+// a sampler thread on the host) to the processing task, which drains them in
+// blocks. Like lib_ptc.c, nothing in here touches the hardware.
+//****************************************************
+
+#ifndef LIB_SAMPLE_RING_H
+#define LIB_SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Head and tail count samples forever (wrapping at 2**32), and the buffer
+// index is the count mod size; so size must be a power of two, and the ring
+// holds all 'size' slots (there's no wasted slot to tell full from empty).
+// Only the producer writes head, n_pushed, n_overflows and high_water; only
+// the consumer writes tail. Each side reads the other's index with acquire
+// semantics and publishes its own with release semantics, so no locks and no
+// disabling of interrupts are needed.
+struct sample_ring {
+    uint16_t *buf;
+    uint32_t size;		// A power of two.
+    uint32_t head;		// Samples pushed so far (and not dropped).
+    uint32_t tail;		// Samples popped so far.
+    uint32_t n_overflows;	// Samples dropped because the ring was full.
+    uint32_t high_water;	// The most samples ever waiting at once.
+};
+
+// Set 'r' up over buf[size]. Returns false if size isn't a power of two.
+bool sample_ring_init (struct sample_ring *r, uint16_t *buf, uint32_t size);
+
+// Producer side (e.g., from an ISR). If the ring is full, the sample is
+// dropped and counted in n_overflows, and this returns false.
+bool sample_ring_push (struct sample_ring *r, uint16_t sample);
+
+// The same for in[n] (e.g., from a DMA half-transfer ISR), published all at
+// once. Whatever doesn't fit is dropped and counted; returns how many fit.
+uint32_t sample_ring_push_block (struct sample_ring *r, const uint16_t *in,
+				 uint32_t n);
+
+// Consumer side: move up to 'max' of the oldest samples into out[], and
+// return how many were moved.
+uint32_t sample_ring_pop_block (struct sample_ring *r, uint16_t *out,
+				uint32_t max);
+
+// How many samples are waiting. From the consumer, that's a lower bound;
+// from the producer, an upper bound.
+uint32_t sample_ring_count (const struct sample_ring *r);
+
+// The statistics, safe to read from either side (or a third party).
+struct sample_ring_stats {
+    uint32_t n_pushed, n_popped, n_overflows, high_water;
+};
+void sample_ring_get_stats (const struct sample_ring *r,
+			    struct sample_ring_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_SAMPLE_RING_H
@@ -0,0 +1,100 @@
+//****************************************************
+// Telemetry frames: the pipeline's internal signals for one sample, packed
+// for streaming out of a UART, so that a laptop can record every signal at
+// the full sample rate (see lab7_host_telemetry.cxx-noop, which decodes the
+// stream into a .ptct trace). Like lib_ptc.c, nothing in here touches the
+// hardware; the board and the host decoder share this code.
+//****************************************************
+
+#ifndef LIB_TELEMETRY_H
+#define LIB_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib_ptc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One frame, everything little-endian:
+//	offset 0   uint8[2]  sync: 0xA5 0x5A
+//	       2   uint16    seq: the sample number, mod 2**16
+//	       4   int32[9]  sample, filtered, peak_1, thresh_1, deriv_2,
+//			     deriv_sq_2, avg_200ms_2, peak_2, thresh_2
+//	      40   uint8     flags: PTC_TLM_WARM, PTC_TLM_DUAL_QRS,
+//			     PTC_TLM_DUAL_QRS_RISE
+//	      41   uint16    CRC-16/CCITT (poly 0x1021, init 0xFFFF) of bytes
+//			     2..40
+// 43 bytes, so at 500 Hz the stream is 21.5 KB/s, about a fifth of what a
+// UART at 1 Mbaud carries. The decoder finds frames by the sync bytes and
+// keeps only those whose CRC checks, so it resynchronizes by itself after
+// garbage or a dropped byte; gaps in seq show frames that were lost.
+#define PTC_TLM_SYNC0		0xA5
+#define PTC_TLM_SYNC1		0x5A
+#define PTC_TLM_N_SIGNALS	9
+#define PTC_TLM_FRAME_SIZE	43
+
+#define PTC_TLM_WARM		0x01
+#define PTC_TLM_DUAL_QRS	0x02
+#define PTC_TLM_DUAL_QRS_RISE	0x04
+
+// Report frames carry occasional statistics (the sample clock's, say) in the
+// same stream, as a type and an array of words whose layout is up to the
+// type:
+//	offset 0   uint8[2]  sync: 0xA5 0x5B
+//	       2   uint8     type: PTC_TLM_REPORT_*
+//	       3   uint8     n: the number of words, at most PTC_TLM_MAX_WORDS
+//	       4   uint32[n] the words
+//	    4+4n   uint16    CRC-16/CCITT, as above, of bytes 2..3+4n
+// The decoder tells the two kinds apart by the second sync byte.
+#define PTC_TLM_REPORT_SYNC1	0x5B
+#define PTC_TLM_MAX_WORDS	63
+#define PTC_TLM_REPORT_SIZE(n)	(6 + 4*(n))
+#define PTC_TLM_MAX_REPORT_SIZE	PTC_TLM_REPORT_SIZE (PTC_TLM_MAX_WORDS)
+
+#define PTC_TLM_REPORT_CLOCK	1	// lib_sample_clock.h's stats.
+#define PTC_TLM_REPORT_PROFILE	2	// A stage of lib_profile.h's.
+#define PTC_TLM_REPORT_TRACE_INFO 3	// lib_trace.h's, before...
+#define PTC_TLM_REPORT_TRACE	4	// ...the events, in chunks.
+#define PTC_TLM_REPORT_MEMORY	5	// lib_memory.h's.
+
+// A decoded frame. signals[] is in the order above.
+struct ptc_tlm_frame {
+    uint16_t seq;
+    int32_t signals[PTC_TLM_N_SIGNALS];
+    uint8_t flags;
+};
+
+uint16_t ptc_tlm_crc16 (const uint8_t *data, uint32_t n);
+
+// Pack the pipeline's output for one sample into out[PTC_TLM_FRAME_SIZE].
+void ptc_tlm_pack (uint8_t *out, uint16_t seq, int sample,
+		   const struct ptc_tick *tick);
+
+// Unpack in[PTC_TLM_FRAME_SIZE] into 'f'. Returns false (leaving 'f' alone)
+// if the sync bytes or the CRC are wrong.
+bool ptc_tlm_unpack (const uint8_t *in, struct ptc_tlm_frame *f);
+
+// A decoded report.
+struct ptc_tlm_report {
+    uint8_t type, n_words;
+    uint32_t words[PTC_TLM_MAX_WORDS];
+};
+
+// Pack words[n_words] as a report of the given type into
+// out[PTC_TLM_REPORT_SIZE (n_words)], and return that size; or 0 if n_words
+// is too many.
+uint32_t ptc_tlm_pack_report (uint8_t *out, uint8_t type,
+			      const uint32_t *words, uint32_t n_words);
+
+// Unpack the report at in[avail] into 'r'. Returns its size; 0 if it's not a
+// good report; or -1 if avail is too short to tell yet.
+int ptc_tlm_unpack_report (const uint8_t *in, uint32_t avail,
+			   struct ptc_tlm_report *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_TELEMETRY_H
@@ -0,0 +1,112 @@
+//****************************************************
+// A scheduler tracer: FreeRTOS's trace hooks (see FreeRTOSConfig.h, where
+// they're defined when we're built with PTC_TRACE) record each task switch,
+// wakeup, queue operation and task notification, timestamped with the cycle
+// counter, into a ring in RAM; interrupts can mark their entry and exit too.
+// The ring always holds the latest PTC_TRACE_N_EVENTS events (a couple of
+// seconds' worth). To read it out, freeze it, send the info and then the
+// events as telemetry reports (lib_telemetry.h), and thaw it; the host turns
+// them into a Chrome/Perfetto trace (lab7_host_telemetry -j).
+//****************************************************
+
+#ifndef LIB_TRACE_H
+#define LIB_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTC_TRACE_N_EVENTS	1024	// A power of two; 8 bytes each.
+#define PTC_TRACE_MAX_TASKS	8
+#define PTC_TRACE_NAME_LEN	16	// As configMAX_TASK_NAME_LEN.
+
+// 'task' is the kernel's task number (uxTCBNumber) for the events that are
+// about a particular task, and 0 for the rest, which belong to whatever is
+// running. 'arg' is the queue number (vQueueSetQueueNumber()) for the queue
+// events, and the interrupt's PTC_TRACE_ISR_* for the interrupt ones.
+enum ptc_trace_type {
+    PTC_TRACE_SWITCH_IN = 1,	// 'task' starts running...
+    PTC_TRACE_SWITCH_OUT,	// ...and stops.
+    PTC_TRACE_READY,		// 'task' was made ready to run.
+    PTC_TRACE_DELAY,		// The running task went into vTaskDelay().
+    PTC_TRACE_QUEUE_SEND,
+    PTC_TRACE_QUEUE_SEND_FAILED,
+    PTC_TRACE_QUEUE_RECEIVE,
+    PTC_TRACE_QUEUE_BLOCK,	// Blocked waiting to receive.
+    PTC_TRACE_NOTIFY_GIVE,	// (From an ISR) to 'task'.
+    PTC_TRACE_NOTIFY_TAKE,
+    PTC_TRACE_NOTIFY_BLOCK,	// Blocked waiting for a notification.
+    PTC_TRACE_ISR_ENTER,
+    PTC_TRACE_ISR_EXIT,
+    PTC_TRACE_N_TYPES
+};
+
+// The interrupts that mark themselves.
+enum { PTC_TRACE_ISR_ADC_DMA = 1 };
+
+struct ptc_trace_event {
+    uint32_t time;		// Counts of ptc_prof_now() (lib_profile.h).
+    uint8_t type, task;
+    uint16_t arg;
+};
+
+// Record an event, from anywhere (a task, an ISR, inside the kernel). It
+// takes a few dozen cycles, with interrupts off.
+void ptc_trace_event (uint8_t type, uint32_t task, uint32_t arg);
+
+// The traceTASK_CREATE hook: remember the task's name.
+void ptc_trace_task_created (uint32_t task, const char *name);
+
+// While the ring is frozen, new events are dropped; so freeze it before
+// reading it out.
+void ptc_trace_freeze (bool frozen);
+
+// For interrupts to mark themselves; they do nothing without PTC_TRACE.
+#ifdef PTC_TRACE
+#define PTC_TRACE_ISR_ENTER(id)	ptc_trace_event (PTC_TRACE_ISR_ENTER, 0, (id))
+#define PTC_TRACE_ISR_EXIT(id)	ptc_trace_event (PTC_TRACE_ISR_EXIT, 0, (id))
+#else
+#define PTC_TRACE_ISR_ENTER(id)	do { } while (0)
+#define PTC_TRACE_ISR_EXIT(id)	do { } while (0)
+#endif
+
+// Reading out a frozen ring as report words. The info report is
+//	counts_per_us, n_events, n_lost (events overwritten since the ring
+//	was last read out), n_tasks, then per task its number and its name
+//	(16 bytes, NUL-padded) as 4 words
+// and then the events come in chunks of up to PTC_TRACE_CHUNK events, each
+//	the index of its first event (0 is the oldest), then per event its
+//	time and (type | task << 8 | arg << 16)
+// Each returns the number of words. A chunk is empty once 'first' is past
+// the end.
+#define PTC_TRACE_INFO_WORDS	(4 + 5*PTC_TRACE_MAX_TASKS)
+#define PTC_TRACE_CHUNK		31
+#define PTC_TRACE_CHUNK_WORDS	(1 + 2*PTC_TRACE_CHUNK)
+uint32_t ptc_trace_info_words (uint32_t *words);
+uint32_t ptc_trace_chunk_words (uint32_t first, uint32_t *words);
+
+// And back, on the host. These return false if the words don't make sense.
+struct ptc_trace_info {
+    uint32_t counts_per_us, n_events, n_lost, n_tasks;
+    struct {
+	uint32_t task;
+	char name[PTC_TRACE_NAME_LEN + 1];
+    } tasks[PTC_TRACE_MAX_TASKS];
+};
+bool ptc_trace_info_from_words (const uint32_t *words, uint32_t n_words,
+				struct ptc_trace_info *info);
+// Puts the chunk's events in events[first..first+n), where n is returned in
+// *n_events; events[] has room for n_max.
+bool ptc_trace_chunk_from_words (const uint32_t *words, uint32_t n_words,
+				 struct ptc_trace_event *events,
+				 uint32_t n_max, uint32_t *first,
+				 uint32_t *n_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIB_TRACE_H
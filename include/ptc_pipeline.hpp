@@ -0,0 +1,723 @@
+//****************************************************
+// The single-channel PTC pipeline, specialized at compile time.
+// A Config fixes the sample rate, the window length and the lowpass; from
+// those, every other constant (window size, refractory period, warm-up,
+// threshold decay, even the lowpass coefficients) is computed at compile time.
+// So the biquad cascade unrolls completely, the derivative taps are
+// immediates, and the window average divides by a constant (with a
+// multiply).
+// Each Config is a separate instantiation with no runtime parameters; the
+// board uses one (ptc_pipeline.cpp) and the host tools can pick from several.
+//****************************************************
+
+#ifndef PTC_PIPELINE_HPP
+#define PTC_PIPELINE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <type_traits>
+#include <utility>
+#include "lib_ptc.h"
+#include "lib_profile.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace ptc {
+
+//****************************************************
+// Compile-time math for filter design (<cmath> isn't constexpr).
+// These are only meant for the well-behaved arguments used below.
+//****************************************************
+
+namespace cx {
+constexpr double pi = 3.14159265358979323846;
+
+constexpr double sqrt (double x) {
+    if (x <= 0) return (0);
+    double r = (x > 1) ? x : 1;
+    for (int i=0; i<64; ++i) r = 0.5 * (r + x/r);
+    return (r);
+}
+
+constexpr double exp (double x) {
+    // Halve x until the power series converges fast, then square back up.
+    int k=0;
+    while ((x > 0.5) || (x < -0.5)) { x /= 2; ++k; }
+    double term=1, sum=1;
+    for (int n=1; n<24; ++n) { term *= x/n; sum += term; }
+    while (k-- > 0) sum *= sum;
+    return (sum);
+}
+
+constexpr double log (double x) {	// Halley's method on exp(y)=x.
+    double y=0;
+    for (int i=0; i<64; ++i) {
+	double e = exp (y);
+	y += 2 * (x-e) / (x+e);
+    }
+    return (y);
+}
+
+constexpr double sinh (double x) { return ((exp(x) - exp(-x)) / 2); }
+constexpr double cosh (double x) { return ((exp(x) + exp(-x)) / 2); }
+constexpr double asinh (double x) { return (log (x + sqrt (x*x + 1))); }
+
+// Reduce x to [-pi, pi].
+constexpr double reduce (double x) {
+    return (x - 2*pi * (double)(long long)(x/(2*pi) + ((x < 0) ? -0.5 : 0.5)));
+}
+
+constexpr double sin (double x) {
+    // In [-pi/2, pi/2], where the power series converges quickly.
+    x = reduce (x);
+    if (x > pi/2) x = pi - x;
+    else if (x < -pi/2) x = -pi - x;
+    double term=x, sum=x;
+    for (int n=1; n<16; ++n) { term *= -x*x / ((2*n)*(2*n+1)); sum += term; }
+    return (sum);
+}
+constexpr double cos (double x) {
+    x = reduce (x);
+    if ((x > pi/2) || (x < -pi/2))
+	return (-cos ((x > 0) ? pi - x : -pi - x));
+    double term=1, sum=1;
+    for (int n=1; n<16; ++n) { term *= -x*x / ((2*n-1)*(2*n)); sum += term; }
+    return (sum);
+}
+constexpr double tan (double x) { return (sin(x) / cos(x)); }
+} // namespace cx
+
+//****************************************************
+// Lowpass designs.
+//****************************************************
+
+// A cascade of biquad sections, in the same form as biquad_20Hz_lowpass[].
+template <int N_SECS>
+struct Sos {
+    static constexpr int n_secs = N_SECS;
+    biquadcoeffs sec[N_SECS];
+};
+
+// Chebyshev type-I lowpass of even 'ORDER', with 'ripple_db' of passband
+// ripple up to 'f_pass', at a sample rate of 'f_samp' (via the bilinear
+// transform). Like biquad_20Hz_lowpass[], the sections go from lowest Q to
+// highest, and the first one carries the whole gain.
+template <int ORDER>
+constexpr Sos<ORDER/2> chebyshev1_lowpass (double f_pass, double f_samp,
+					   double ripple_db) {
+    static_assert ((ORDER > 0) && (ORDER%2 == 0), "Need an even order");
+    const double eps = cx::sqrt (cx::exp (ripple_db/10 * cx::log(10.0)) - 1);
+    const double mu = cx::asinh (1/eps) / ORDER;
+    const double k = cx::tan (cx::pi * f_pass / f_samp);  // Prewarped edge.
+
+    Sos<ORDER/2> sos {};
+    double gain = 1 / cx::sqrt (1 + eps*eps);  // DC sits at the ripple bottom.
+    for (int i=0; i<ORDER/2; ++i) {
+	// Each analog pole pair p (with s=1 at the band edge) gives
+	//	H(s) = |p|^2 / (s^2 - 2*re(p)*s + |p|^2),
+	// and then s -> (1 - z^-1)/(1 + z^-1).
+	double theta = (2*(ORDER/2 - i) - 1) * cx::pi / (2*ORDER);
+	double re = -cx::sinh(mu) * cx::sin(theta) * k;
+	double im =  cx::cosh(mu) * cx::cos(theta) * k;
+	double mag2 = re*re + im*im;
+	double a0 = 1 - 2*re + mag2;
+	gain *= mag2/a0;
+	sos.sec[i] = { 1.0f, 2.0f, 1.0f, 1.0f,
+		       (float)(2*(mag2-1)/a0), (float)((1 + 2*re + mag2)/a0) };
+    }
+    sos.sec[0].b0 = (float)gain;
+    sos.sec[0].b1 = (float)(2*gain);
+    sos.sec[0].b2 = (float)gain;
+    return (sos);
+}
+
+// The board's 20Hz lowpass, exactly as in lib_ptc.c. (It's
+// chebyshev1_lowpass<4>(20, 500, 0.4), rounded to float.)
+struct BoardLowpass {
+    static constexpr Sos<N_BIQUAD_SECS> sos = { BIQUAD_20HZ_LOWPASS_COEFFS };
+};
+
+// The same 20Hz lowpass, designed for another sample rate.
+template <int RATE>
+struct Lowpass20Hz {
+    static constexpr Sos<2> sos = chebyshev1_lowpass<4> (20.0, RATE, 0.4);
+};
+
+//****************************************************
+// The stages. All state has default member initializers, so that a
+// statically-allocated pipeline needs no constructor to run at startup.
+//****************************************************
+
+// The lowpass in float; the same arithmetic as biquad_cascade() with n_bits=12.
+template <class Design>
+class FloatLowpass {
+  public:
+    static constexpr int n_secs = Design::sos.n_secs;
+    static constexpr int max_out = INT32_MAX;	// Float doesn't saturate.
+
+    bool init () { *this = FloatLowpass(); return (true); }
+
+    int step (int sample) {
+	float x = (float)sample * (1.0f / SCALE);
+	sections (x, std::make_index_sequence<n_secs>());
+	return ((int)(x * SCALE));
+    }
+
+  private:
+    static constexpr float SCALE = (float)(1<<12);
+
+    template <size_t... S>
+    void sections (float &x, std::index_sequence<S...>) {
+	((x = section<S> (x)), ...);
+    }
+
+    template <size_t S>
+    float section (float xn) {
+	constexpr biquadcoeffs c = Design::sos.sec[S];
+	biquadstate &st = state[S];
+	float yn = c.b0*xn + c.b1*st.x_nm1 + c.b2*st.x_nm2
+		 - c.a1*st.y_nm1 - c.a2*st.y_nm2;
+	st.x_nm2 = st.x_nm1;  st.x_nm1 = xn;
+	st.y_nm2 = st.y_nm1;  st.y_nm1 = yn;
+	return (yn);
+    }
+
+    biquadstate state[n_secs] = {};
+};
+
+// The lowpass in Q31; bit-identical to biquad_cascade_q31() with n_bits=12.
+// The quantizer in lib_ptc.c isn't constexpr, so the Q31 coefficients are
+// computed once by init() rather than at compile time.
+template <class Design>
+class Q31Lowpass {
+  public:
+    static constexpr int n_secs = Design::sos.n_secs;
+    // The output saturates at the headroom.
+    static constexpr int max_out = 1 << (12 + BIQUAD_Q_HEADROOM);
+
+    bool init () {
+	*this = Q31Lowpass();
+	post_shift = biquad_quantize_q31 (Design::sos.sec, n_secs, coeffs);
+	return (post_shift >= 0);
+    }
+
+    int step (int sample) {
+	int32_t x = sat ((int64_t)sample * ((int64_t)1 << IN_SHIFT));
+	sections (x, std::make_index_sequence<n_secs>());
+	return ((int)(((int64_t)x + ((int64_t)1 << (IN_SHIFT-1))) >> IN_SHIFT));
+    }
+
+  private:
+    static constexpr int IN_SHIFT = 31 - BIQUAD_Q_HEADROOM - 12;
+
+    static int32_t sat (int64_t x) {
+	return ((x > INT32_MAX) ? INT32_MAX : (x < INT32_MIN) ? INT32_MIN
+		: (int32_t)x);
+    }
+
+    template <size_t... S>
+    void sections (int32_t &x, std::index_sequence<S...>) {
+	((x = section<S> (x)), ...);
+    }
+
+    template <size_t S>
+    int32_t section (int32_t xn) {
+	const biquad_q31_coeffs &c = coeffs[S];
+	biquad_q31_state &st = state[S];
+	const int acc_shift = 31 - post_shift;
+	int64_t acc = (int64_t)1 << (acc_shift-1);
+	acc += (int64_t)c.b0*xn       + (int64_t)c.b1*st.x_nm1
+	     + (int64_t)c.b2*st.x_nm2 + (int64_t)c.a1*st.y_nm1
+	     + (int64_t)c.a2*st.y_nm2;
+	int32_t yn = sat (acc >> acc_shift);
+	st.x_nm2 = st.x_nm1;  st.x_nm1 = xn;
+	st.y_nm2 = st.y_nm1;  st.y_nm1 = yn;
+	return (yn);
+    }
+
+    biquad_q31_coeffs coeffs[n_secs] = {};
+    biquad_q31_state state[n_secs] = {};
+    int post_shift = 0;
+};
+
+// Streaming FIR filter with integer taps known at compile time:
+//	y[n] = (h[0]*x[n] + h[1]*x[n-1] + ... + h[L-1]*x[n-L+1]) >> shift
+// where x[n] is the sample being pushed. Taps is a type with
+//	static constexpr int shift;
+//	static constexpr std::array<int32_t, L> h;
+// like the ones below. (Note that the >> rounds down, as the original
+// deriv_5pt() did.)
+// The history is a ring written twice, at pos and at pos+L, so the last L
+// samples are always contiguous and there's never a modulo. Per sample, the
+// dot product is unrolled, with zero taps dropped at compile time. The block
+// version lines the history up in front of the new samples and goes
+// tap-major, which vectorizes; on the host with AVX2, it's explicitly eight
+// samples at a time.
+// The sum is 32 bits if it can't overflow for inputs up to 14 bits, and 64
+// bits otherwise.
+template <class Taps>
+class Fir {
+  public:
+    static constexpr int L = (int) Taps::h.size();
+    static constexpr int shift = Taps::shift;
+
+    static constexpr int64_t abs_sum () {
+	int64_t sum = 0;
+	for (int32_t t : Taps::h) sum += (t < 0) ? -(int64_t)t : t;
+	return (sum);
+    }
+    using Acc = typename std::conditional<(abs_sum() <= (INT32_MAX>>14)),
+					  int32_t, int64_t>::type;
+
+    // The biggest output for (up to) 13-bit inputs, i.e., the same inputs
+    // as the lowpasses take; so an Fir can stand in for the lowpass in a
+    // Config.
+    static constexpr int max_out =
+	(int) (((abs_sum() << 13) >> shift) < INT32_MAX
+	       ? ((abs_sum() << 13) >> shift) : INT32_MAX);
+
+    bool init () { *this = Fir(); return (true); }
+
+    int step (int sample) {
+	if (--pos < 0) pos = L-1;
+	hist[pos] = hist[pos+L] = sample;
+	return (dot (&hist[pos], std::make_index_sequence<L>()));
+    }
+
+    // Block version: out[i] is what step(in[i]) would return. It needs
+    // L-1+CHUNK ints of stack, so use it on the host or for short filters.
+    void step_block (const int *in, int *out, int n) {
+	int buf[L-1 + CHUNK];
+	while (n > 0) {
+	    int len = (n < CHUNK) ? n : CHUNK;
+
+	    // buf[] is the last L-1 samples, oldest first, then the block.
+	    for (int j=0; j<L-1; ++j)
+		buf[j] = hist[pos + L-2 - j];
+	    for (int i=0; i<len; ++i)
+		buf[L-1 + i] = in[i];
+	    filter_block (buf, out, len);
+
+	    // The newest L samples become the history.
+	    pos = 0;
+	    for (int k=0; k<L; ++k)
+		hist[k] = hist[k+L] = buf[L-2 + len - k];
+	    in += len;  out += len;  n -= len;
+	}
+    }
+
+  private:
+    static constexpr int CHUNK = 32;
+
+    template <size_t K>
+    static Acc term (const int *w) {
+	if constexpr (Taps::h[K] == 0) return (0);
+	else return ((Acc)Taps::h[K] * w[K]);
+    }
+
+    template <size_t... K>
+    static int dot (const int *w, std::index_sequence<K...>) {
+	return ((int) ((term<K> (w) + ... + 0) >> shift));
+    }
+
+    // out[i] = the filter at buf[L-1+i], for i<len.
+    static void filter_block (const int *buf, int *out, int len) {
+	int i=0;
+#if defined(__AVX2__)
+	if constexpr (sizeof (Acc) == 4)
+	    for (; i+8<=len; i+=8) {
+		__m256i acc = _mm256_setzero_si256();
+		for (int k=0; k<L; ++k)
+		    if (Taps::h[k] != 0)
+			acc = _mm256_add_epi32 (acc, _mm256_mullo_epi32 (
+				_mm256_set1_epi32 (Taps::h[k]),
+				_mm256_loadu_si256 ((const __m256i *)
+						    &buf[L-1 + i-k])));
+		_mm256_storeu_si256 ((__m256i *)&out[i],
+				     _mm256_srai_epi32 (acc, shift));
+	    }
+#endif
+	for (; i<len; ++i) {
+	    Acc acc = 0;
+	    for (int k=0; k<L; ++k)
+		acc += (Acc)Taps::h[k] * buf[L-1 + i-k];
+	    out[i] = (int) (acc >> shift);
+	}
+    }
+
+    int hist[2*L] = {};
+    int pos = 0;	// hist[pos+k] is x[n-k].
+};
+
+// The 5-point derivative (-x[n-5] - 2*x[n-4] + 2*x[n-2] + x[n-1]) / 8,
+// where x[n] is the new sample; i.e., a differentiator with a delay of three
+// samples. This used to be deriv_5pt() in lab7_main.c.
+struct Deriv5ptTaps {
+    static constexpr int shift = 3;
+    static constexpr std::array<int32_t, 6> h = { 0, 1, 2, 0, -2, -1 };
+};
+using Deriv5pt = Fir<Deriv5ptTaps>;
+
+// A light smoother: the binomial [1 4 6 4 1]/16, with unity DC gain.
+struct Smooth5Taps {
+    static constexpr int shift = 4;
+    static constexpr std::array<int32_t, 5> h = { 1, 4, 6, 4, 1 };
+};
+
+// Windowed-sinc (Hamming) bandpass from 'f_lo' to 'f_hi' Hz at a sample rate
+// of 'f_samp', with N (odd) taps scaled by 2**shift and rounded. The gain is
+// 1 in the middle of the band.
+template <int N>
+constexpr std::array<int32_t, N> fir_bandpass (double f_lo, double f_hi,
+					       double f_samp, int shift) {
+    static_assert (N%2 == 1, "Need an odd length");
+    double real[N] = {};
+    for (int n=0; n<N; ++n) {
+	double m = n - (N-1)/2;
+	auto lowpass = [m, f_samp] (double fc) {
+	    double w = 2*cx::pi*fc/f_samp;
+	    return ((m == 0) ? w/cx::pi : cx::sin(w*m) / (cx::pi*m));
+	};
+	double window = 0.54 - 0.46*cx::cos (2*cx::pi*n/(N-1));
+	real[n] = window * (lowpass (f_hi) - lowpass (f_lo));
+    }
+
+    // Scale for unit gain at the band center.
+    double w0 = cx::pi * (f_lo+f_hi) / f_samp, re=0, im=0;
+    for (int n=0; n<N; ++n) {
+	re += real[n] * cx::cos (w0*n);
+	im -= real[n] * cx::sin (w0*n);
+    }
+    double gain = cx::sqrt (re*re + im*im);
+
+    std::array<int32_t, N> h {};
+    for (int n=0; n<N; ++n) {
+	double v = real[n] / gain * (double)(1<<shift);
+	h[n] = (int32_t) ((v < 0) ? v-0.5 : v+0.5);
+    }
+    return (h);
+}
+
+// The Pan-Tompkins 5-15 Hz QRS bandpass, 200ms long (so its delay is
+// 100ms). It can stand in for the lowpass in a Config.
+template <int RATE>
+struct Bandpass5to15HzTaps {
+    static constexpr int shift = 15;
+    static constexpr auto h = fir_bandpass<(RATE/5) | 1> (5, 15, RATE, shift);
+};
+
+// Usually returns 0; but when the input has just peaked (its derivative went
+// from >=0 to <0), returns the input.
+class PeakFinder {
+  public:
+    int step (int sample) {
+	int deriv = deriv_5pt.step (sample);
+	bool peak = (prev_deriv >= 0) && (deriv < 0);
+	prev_deriv = deriv;
+	return (peak? sample : 0);
+    }
+
+  private:
+    Deriv5pt deriv_5pt;
+    int prev_deriv = 0;
+};
+
+// Exact unsigned 32-bit division by a divisor that's fixed when the object is
+// made: a shift for a power of two, and otherwise a multiply and shifts
+// (Granlund & Montgomery, "Division by invariant integers using
+// multiplication", fig. 4.1). The compiler does this by itself for a
+// constant divisor at -O2, but at -Os (which is what the board builds with)
+// it emits a UDIV instead, and it can't do it at all for a run-time divisor.
+class Reciprocal {
+  public:
+    constexpr explicit Reciprocal (uint32_t d) {
+	while (((uint64_t)1 << log2) < d) ++log2;	// ceil(log2(d))
+	pow2 = (((uint64_t)1 << log2) == d);
+	if (!pow2)
+	    mult = (uint32_t) ((((uint64_t)1<<32) * (((uint64_t)1<<log2) - d))
+			       / d + 1);
+    }
+
+    constexpr uint32_t divide (uint32_t x) const {
+	if (pow2)
+	    return (x >> log2);
+	uint32_t t = (uint32_t) (((uint64_t)x * mult) >> 32);
+	return ((t + ((x - t) >> 1)) >> (log2 - 1));
+    }
+
+  private:
+    int log2 = 0;
+    bool pow2 = true;
+    uint32_t mult = 0;
+};
+
+// Running average over the last N samples, each in [0, MAX_IN]; e.g., of a
+// squared derivative. Each instance has its own state, so we can have as many
+// windows (of whatever widths, for however many channels) as we like.
+//    - The ring wraps with a compare, never a modulo.
+//    - The sum is unsigned and kept incrementally (add the new sample,
+//	subtract the one leaving). Unsigned wraparound makes that exact as
+//	long as the true sum fits, which we check at compile time: the sum is
+//	32 bits when N*MAX_IN fits, and 64 bits otherwise.
+//    - With a 32-bit sum, the divide by N is a Reciprocal (a shift if N is a
+//	power of two). A 64-bit sum just divides.
+template <int N, uint64_t MAX_IN>
+class WindowAverage {
+  public:
+    static_assert (N > 0, "Empty window");
+    static constexpr bool SUM32 = (MAX_IN <= UINT32_MAX / N);
+    using Sum = typename std::conditional<SUM32, uint32_t, uint64_t>::type;
+
+    int step (int sample) {
+	sum += (Sum)(uint32_t)sample - buf[ptr];
+	buf[ptr] = (uint32_t)sample;
+	if (++ptr == N) ptr = 0;
+	return (average());
+    }
+
+    // Empty the window, in place.
+    void reset () {
+	memset (buf, 0, sizeof buf);
+	ptr = 0;
+	sum = 0;
+    }
+
+    // Block version: out[i] is what step(in[i]) would return. The inner
+    // loop runs up to the next wrap of the ring with no wrap check.
+    void step_block (const int *in, int *out, int n) {
+	while (n > 0) {
+	    int run = (N - ptr < n) ? N - ptr : n;
+	    for (int i=0; i<run; ++i) {
+		sum += (Sum)(uint32_t)in[i] - buf[ptr+i];
+		buf[ptr+i] = (uint32_t)in[i];
+		out[i] = average();
+	    }
+	    ptr += run;
+	    if (ptr == N) ptr = 0;
+	    in += run;  out += run;  n -= run;
+	}
+    }
+
+    int average () const {
+	if constexpr (SUM32)
+	    return ((int) RECIP.divide (sum));
+	else
+	    return ((int) (sum / N));
+    }
+
+  private:
+    static constexpr Reciprocal RECIP { (uint32_t)N };
+    uint32_t buf[N] = {};
+    int ptr = 0;
+    Sum sum = 0;
+};
+
+// The moving threshold (it used to be threshold() in lab7_main.c): a
+// running max & min of the peaks, decaying toward each other by DECAY per
+// peak, and their average. Non-peaks (<=0) change nothing.
+template <int DECAY, int MIN_INIT>
+class Threshold {
+  public:
+    int step (int psample) {
+	if (psample <= 0) return (thresh);
+	if (psample > max) max = psample;
+	if (psample < min) min = psample;
+	max -= DECAY;  if (max < 0x000) max = 0x000;
+	min += DECAY;  if (min > 0xFFF) min = 0xFFF;
+	thresh = (min + max) / 2;
+	return (thresh);
+    }
+    int value () const { return (thresh); }
+
+  private:
+    int thresh = 0x7FF, max = 0x000, min = MIN_INIT;
+};
+
+//****************************************************
+// Configurations.
+//****************************************************
+
+// Everything about a pipeline that's known at compile time. The timing
+// constants are all set in milliseconds (or per second), and converted to
+// samples here; at 500 Hz, they come out to the numbers the board has always
+// used (window 100, refractory 100, warm-up 250, decays 15 & 4).
+template <int RATE, int WINDOW_MS, class LOWPASS>
+struct Config {
+    static_assert (RATE > 0, "Bad sample rate");
+    using Lowpass = LOWPASS;
+
+    static constexpr int sample_rate = RATE;
+    static constexpr int window_size = RATE * WINDOW_MS / 1000;
+    static constexpr int refractory_ticks = RATE * 200 / 1000;
+    static constexpr int warmup_samples = RATE * 500 / 1000;
+
+    // The thresholds decay by a fixed amount per second (7500 and 2000 ADC
+    // counts/sec); per sample, that's at least one count.
+    static constexpr int per_sample (int per_sec) {
+	return ((per_sec + RATE/2)/RATE > 0 ? (per_sec + RATE/2)/RATE : 1);
+    }
+    static constexpr int thresh1_decay = per_sample (7500);
+    static constexpr int thresh2_decay = per_sample (2000);
+
+    // The biggest deriv_sq_2 can get (it's an int): Deriv5pt's gain is 6/8,
+    // on top of whatever the lowpass can put out. That decides how wide the
+    // window sum must be.
+    static constexpr uint64_t max_deriv =
+	((uint64_t)LOWPASS::max_out * Deriv5pt::abs_sum()) >> Deriv5pt::shift;
+    static constexpr uint64_t max_deriv_sq =
+	(max_deriv*max_deriv < INT32_MAX) ? max_deriv*max_deriv : INT32_MAX;
+};
+
+// What the board runs. The lowpass runs in Q31 fixed point rather than
+// float, which takes the FPU out of the per-sample path entirely; build with
+// -DPTC_FLOAT_BIQUAD (in platformio.ini's build_flags, say) for the float
+// one. src/lab7_host_qreport.cxx-noop reports how close the two are.
+#ifdef PTC_FLOAT_BIQUAD
+using Board = Config<PTC_BOARD_SAMPLE_RATE, 200, FloatLowpass<BoardLowpass>>;
+#else
+using Board = Config<PTC_BOARD_SAMPLE_RATE, 200, Q31Lowpass<BoardLowpass>>;
+#endif
+static_assert (Board::window_size == PTC_WINDOW_SIZE
+	       && Board::refractory_ticks == PTC_REFRACTORY_TICKS
+	       && Board::warmup_samples == PTC_WARMUP_SAMPLES,
+	       "The board and the multi-channel pipeline disagree");
+
+//****************************************************
+// The pipeline.
+//****************************************************
+
+template <class Cfg>
+class Pipeline {
+  public:
+    // Back to the power-up state. Returns false if the lowpass can't be set
+    // up. It's done stage by stage, in place: a whole Pipeline() to copy
+    // from would be a temporary the size of the window on a task's stack.
+    bool init () {
+	peak_1 = PeakFinder();
+	peak_2 = PeakFinder();
+	deriv_2.init ();
+	window.reset ();
+	thresh_1 = decltype (thresh_1)();
+	thresh_2 = decltype (thresh_2)();
+	sample_count = refractory_counter = 0;
+	dual_QRS = false;
+	return (lowpass.init());
+    }
+
+    // One sample in (12 bits), everything it produces out. (With
+    // PTC_PROFILE, each stage is timed; see lib_profile.h.)
+    ptc_tick step (int sample) {
+	ptc_tick t;
+	PTC_PROF_START (prof);
+	t.filtered = lowpass.step (sample);
+	PTC_PROF_LAP (prof, PTC_PROF_LOWPASS);
+
+	// Left side: peaks of the filtered signal, and their moving threshold.
+	t.peak_1 = peak_1.step (t.filtered);
+	PTC_PROF_LAP (prof, PTC_PROF_PEAK_1);
+	t.thresh_1 = thresh_1.step (t.peak_1);
+	PTC_PROF_LAP (prof, PTC_PROF_THRESH_1);
+
+	// Right side: squared derivative, averaged over the window.
+	t.deriv_2 = deriv_2.step (t.filtered);
+	t.deriv_sq_2 = t.deriv_2 * t.deriv_2;
+	PTC_PROF_LAP (prof, PTC_PROF_DERIV_2);
+	t.avg_200ms_2 = window.step (t.deriv_sq_2);
+	PTC_PROF_LAP (prof, PTC_PROF_WINDOW_2);
+	t.peak_2 = peak_2.step (t.avg_200ms_2);
+	PTC_PROF_LAP (prof, PTC_PROF_PEAK_2);
+
+	// Ignore startup artifacts. (The count stops once we're warm, so it
+	// can't overflow.)
+	if (sample_count < Cfg::warmup_samples) ++sample_count;
+	t.warm = (sample_count >= Cfg::warmup_samples);
+	if (!t.warm) {
+	    t.thresh_2 = thresh_2.value();
+	    t.dual_QRS = t.dual_QRS_rise = false;
+	    return (t);
+	}
+	t.thresh_2 = thresh_2.step (t.peak_2);
+
+	// Dual-QRS combining left & right sides. Refractory_counter is zeroed
+	// at the dual_QRS falling edge, and counts up each tick after that;
+	// it's to ignore new peaks too close to an existing one.
+	bool last = dual_QRS;
+	++refractory_counter;
+	dual_QRS = (t.filtered > t.thresh_1) && (t.avg_200ms_2 > t.thresh_2)
+		&& (refractory_counter > Cfg::refractory_ticks);
+	if (last && !dual_QRS) refractory_counter = 0;
+	t.dual_QRS = dual_QRS;
+	t.dual_QRS_rise = dual_QRS && !last;
+	PTC_PROF_END (prof, PTC_PROF_THRESH_2, 1);
+	return (t);
+    }
+
+    // Snapshots, for checkpointing and resuming. The pipeline's whole state
+    // is this object, so save() just copies it out, behind a small header
+    // saying which Config it came from; after restore(), the next step()
+    // carries on exactly where the saved pipeline left off. A snapshot is
+    // only good for the same Config in the same build (it's raw memory):
+    // restore() checks the header and returns false, leaving the pipeline
+    // alone, if it doesn't match. Both return false if 'size' isn't
+    // state_size().
+    static constexpr size_t state_size () {
+	return (sizeof (uint32_t[2]) + sizeof (Pipeline));
+    }
+
+    bool save (void *buf, size_t size) const {
+	static_assert (std::is_trivially_copyable<Pipeline>::value,
+		       "A pipeline must be copyable as bytes");
+	if (size != state_size())
+	    return (false);
+	uint32_t header[2] = { STATE_MAGIC, fingerprint() };
+	memcpy (buf, header, sizeof header);
+	memcpy ((char *)buf + sizeof header, (const void *)this,
+		sizeof (Pipeline));
+	return (true);
+    }
+
+    bool restore (const void *buf, size_t size) {
+	uint32_t header[2];
+	if (size != state_size())
+	    return (false);
+	memcpy (header, buf, sizeof header);
+	if ((header[0] != STATE_MAGIC) || (header[1] != fingerprint()))
+	    return (false);
+	memcpy ((void *)this, (const char *)buf + sizeof header,
+		sizeof (Pipeline));
+	return (true);
+    }
+
+  private:
+    static constexpr uint32_t STATE_MAGIC = 0x53435450;	// "PTCS"
+
+    // A hash (FNV-1a) of everything that shapes the state.
+    static constexpr uint32_t fingerprint () {
+	const uint32_t shape[] = {
+	    (uint32_t) sizeof (Pipeline), (uint32_t) Cfg::sample_rate,
+	    (uint32_t) Cfg::window_size, (uint32_t) Cfg::refractory_ticks,
+	    (uint32_t) Cfg::warmup_samples, (uint32_t) Cfg::thresh1_decay,
+	    (uint32_t) Cfg::thresh2_decay, (uint32_t) Cfg::Lowpass::max_out };
+	uint32_t h = 2166136261u;
+	for (uint32_t v : shape)
+	    h = (h ^ v) * 16777619u;
+	return (h);
+    }
+
+    typename Cfg::Lowpass lowpass;
+    PeakFinder peak_1, peak_2;
+    Deriv5pt deriv_2;
+    WindowAverage<Cfg::window_size, Cfg::max_deriv_sq> window;
+    Threshold<Cfg::thresh1_decay, 0xFFF> thresh_1;
+    Threshold<Cfg::thresh2_decay, 0x2FF> thresh_2;
+    int sample_count = 0;
+    int refractory_counter = 0;
+    bool dual_QRS = false;
+};
+
+} // namespace ptc
+
+#endif // PTC_PIPELINE_HPP
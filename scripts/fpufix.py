@@ -9,6 +9,12 @@ for e in [env, projenv, DefaultEnvironment()]:
             "-mfloat-abi=hard",
             "-mfpu=fpv4-sp-d16",
         ],
+        CXXFLAGS=[
+            # The PTC pipeline (ptc_pipeline.hpp) uses C++17.
+            "-std=gnu++17",
+            "-fno-exceptions",
+            "-fno-rtti",
+        ],
         LINKFLAGS=[
             "-mfloat-abi=hard",
             "-mfpu=fpv4-sp-d16",
@@ -1,4 +1,4 @@
-import re, numpy as np, matplotlib.pyplot as plt
+import os, re, sys, numpy as np, matplotlib.pyplot as plt
 #import pdb; pdb.set_trace()
 
 # Globals used to build a data structure.
@@ -45,6 +45,41 @@ def parse_inputfile (filename):
     for idx in range(len(values)):
         values[idx] = np.array(values[idx])
 
+# Load a binary trace (written by "lab7_host -b"; the format is described in
+# include/host/trace_file.hpp) into the same data structure. Nothing is
+# parsed or copied: the file is memory-mapped, and each entry of values[] is
+# a numpy view straight onto that signal's column in the file.
+TRACE_MAGIC = b"PTCTRACE"
+def load_trace (filename):
+    global signal_names, values
+    header = np.fromfile (filename, dtype=np.uint8, count=40)
+    assert header[:8].tobytes() == TRACE_MAGIC, "Not a trace file"
+    version, n_signals = header[8:16].view("<u4")
+    n_samples, stride = header[16:32].view("<u8")
+    sample_rate, data_offset = header[32:40].view("<u4")
+    assert version == 1, "Unknown trace version"
+
+    names = np.fromfile (filename, dtype="S32", count=n_signals, offset=40)
+    signal_names = [n.decode() for n in names]
+    # An empty record has no columns, and mmap can't map zero bytes.
+    if (n_samples == 0):
+        values = [np.zeros (0, dtype="<i4") for n in names]
+        return
+    assert (os.path.getsize (filename) >= data_offset + n_signals*stride*4), \
+        "Truncated trace file"
+    columns = np.memmap (filename, dtype="<i4", mode="r", offset=data_offset,
+                         shape=(n_signals, stride))
+    values = [columns[i, :n_samples] for i in range(n_signals)]
+
+# Read either kind of file.
+def load_file (filename):
+    with open (filename, "rb") as f:
+        is_trace = (f.read(len(TRACE_MAGIC)) == TRACE_MAGIC)
+    if (is_trace):
+        load_trace (filename)
+    else:
+        parse_inputfile (filename)
+
 # Your routine to plot whatever signals you like.
 def plot_what_you_want():
     print ("plotting...")
@@ -71,5 +106,7 @@ def plot_signal (signame, times=1, plus=0, spacing=.002):
     data = values[idx]*times + plus
     plt.plot (x_axis, data, label=signame, marker=".")
 
-parse_inputfile ("run.out")
+# Plot "run.out" by default, or whatever file is on the command line (text or
+# binary trace).
+load_file (sys.argv[1] if len(sys.argv) > 1 else "run.out")
 plot_what_you_want()
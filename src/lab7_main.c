@@ -12,227 +12,390 @@
 #include "portmacro.h"
 #include "task.h"
 #include "timers.h"
+#include "queue.h"
 
 #include "stm32l4xx.h"
 #include "stm32l432xx.h"
 #include <stdbool.h>
 #include "lib_ee152.h"
-
-// Dual_QRS indicates that both the left & right side of the algorithm believe
-// we have a QRS, and that we're not in the refractory period.
-// Dual_QRS_last is just a one-cycle-delayed version of dual_QRS; it's used to
-// detect the rising edge of dual_QRS.
-static bool dual_QRS = false;
-static bool dual_QRS_last = false;
+#include "lib_ptc.h"
+#include "lib_sample_ring.h"
+#include "lib_sample_clock.h"
+#include "lib_telemetry.h"
+#include "lib_profile.h"
+#include "lib_trace.h"
+#include "lib_memory.h"
+#include "lib_pool.h"
 
 //****************************************************
-// Biquad filtering.
+// QRS events.
 //****************************************************
 
-struct biquadcoeffs {	// The coefficients of a single biquad section.
-    float b0, b1, b2,	// numerator
-	  a0, a1, a2;	// denominator
+// Dual_QRS indicates that both the left & right side of the algorithm believe
+// we have a QRS, and that we're not in the refractory period. Each rising
+// edge of it is a new beat, which the main loop publishes as a QRS event to
+// every task that wants to know (the beeper and the display), each through
+// its own queue; they just block on their queue until a beat comes along.
+// The times are in samples, so they're exactly as accurate as the hardware
+// sample clock, however late the tasks get to run.
+//
+// The event itself is in a block from a pool (lib_pool.h), and the queues
+// carry pointers to it, so each beat is written once however many tasks get
+// it; the last of them to be done with it gives the block back.
+struct qrs_event {
+    uint32_t sample;	// The sample number of the QRS onset.
+    uint32_t rr;	// Samples since the previous onset (0 for the first).
+    int32_t amplitude;	// The right-side peak (peak_2) at the onset.
 };
-// Our 20Hz lowpass filter is built from two biquad sections.
-#define N_BIQUAD_SECS 2	// Number of biquad sections in our filter.
-static struct biquadcoeffs biquad_20Hz_lowpass[2] = {
-	{8.59278969e-05f, 1.71855794e-04f, 8.59278969e-05f,
-	 1.0f,		-1.77422345e+00f, 7.96197268e-01f},
-	{1.0f,	2.0f,	1.0f,
-	 1.0f,	-1.84565849e+00f,	9.11174670e-01f}};
-
-// All DSP filters need state.
-struct biquadstate { float x_nm1, x_nm2, y_nm1, y_nm2; };
-static struct biquadstate biquad_state[N_BIQUAD_SECS] = {0};
-
-// Biquad filtering routine.
-// - The input is assumed to be a 12-bit unsigned integer coming straight from
-//   the ADC. We convert it immediately to a float xn in the range [0,1).
-// - Compute yn = b0*xn + b1*x_nm1 + b2*x_nm2 - a1*y_nm1 - a2*y_nm2
-// - Update x_nm1->x_nm2, xn->x_nm1, y_nm1->y_nm2, yn->y_nm1
-// - Return yn as a 12-bit integer.
-int biquad (const struct biquadcoeffs *coeffs, struct biquadstate *state,
-	    uint32_t sample, uint32_t n_bits) {
-    float xn = ((float)sample) / ((float)(1<<n_bits)); // current sample
-    float yn = coeffs->b0*xn + coeffs->b1*state->x_nm1 + coeffs->b2*state->x_nm2
-	     - coeffs->a1*state->y_nm1 - coeffs->a2*state->y_nm2; // output
-
-    state->x_nm2 = state->x_nm1;
-    state->x_nm1 = xn;
-    state->y_nm2 = state->y_nm1;
-    state->y_nm1 = yn;
-
-    return (yn * (1<<n_bits));
-}
-
-//****************************************************
-// Calculate a derivative with a fancy five-point algorithm.
-//****************************************************
-
-// Compute derivative using a 5-point algorithm.
-// Given an input 'sample', keep track of its last 5 values, which they call
-// xp2, xp1, x0, xm1 and xm2. Then when we get a new sample, compute & return
-//	(-xm2 - 2*xm1 + 2*xp1 + xp2)/8
-// and then shift to do xm2=xm1, xm1=x0, x0=xp1, xp1=xp2, xp2=sample
-// So you can think of this as implementing a differentiator with a delay of
-// two time units.
-struct deriv_5pt_state {
-    int xp2, xp1, x0, xm1, xm2;
+struct qrs_beat {
+    struct qrs_event ev;
+    uint32_t n_refs;	// Consumers that have yet to let go of it.
 };
 
-struct deriv_5pt_state deriv_5pt_state = { 0 };
-struct deriv_5pt_state deriv_5pt_state1 = { 0 };
-struct deriv_5pt_state deriv_5pt_state2 = { 0 };
-
-int deriv_5pt (int sample, struct deriv_5pt_state *state) {
-    int r = -state->xm2 - 2*state->xm1 + 2*state->xp1 + state->xp2;
-    r = r>>3;	// Divide by 8.
+// The queues are a few beats deep, which is a second or more of slack. If a
+// consumer ever falls that far behind, the beat is dropped for it and
+// counted. There are enough blocks for every queue to be full of different
+// beats with one more being published, so the pool can't run dry unless a
+// block leaks; but if it ever does, the beat is dropped for everyone, and
+// counted too. So for each consumer c (look at qrs_stats with the debugger),
+//	n_beats == n_no_block + n_dropped[c] + n_received[c]
+//		   + what's still in c's queue.
+// The memory report includes the pool's stats.
+#define QRS_QUEUE_LEN 4
+enum { QRS_BEEP, QRS_DISPLAY, QRS_N_CONSUMERS };
+#define QRS_N_BEATS (QRS_N_CONSUMERS * QRS_QUEUE_LEN + 1)
+static QueueHandle_t qrs_queues[QRS_N_CONSUMERS];
+static StaticQueue_t qrs_queue_structs[QRS_N_CONSUMERS];	// See main().
+static uint8_t qrs_queue_storage[QRS_N_CONSUMERS]
+				[QRS_QUEUE_LEN * sizeof (struct qrs_beat *)];
+static struct ptc_pool qrs_pool;
+static void *qrs_pool_storage[PTC_POOL_PTRS (sizeof (struct qrs_beat),
+					     QRS_N_BEATS)];
+static struct {
+    uint32_t n_beats;				// Published.
+    uint32_t n_no_block;			// The pool was empty.
+    uint32_t n_dropped[QRS_N_CONSUMERS];	// Queue was full.
+    uint32_t n_received[QRS_N_CONSUMERS];	// Taken by the consumer.
+} qrs_stats;
+
+// One consumer (or publishing to one) is done with a beat.
+static void qrs_release (struct qrs_beat *beat) {
+    if (__atomic_sub_fetch (&beat->n_refs, 1, __ATOMIC_ACQ_REL) == 0)
+	ptc_pool_free (&qrs_pool, beat);
+}
 
-    state->xm2 = state->xm1;
-    state->xm1 = state->x0;
-    state->x0 = state->xp1;
-    state->xp1 = state->xp2;
-    state->xp2 = sample;
+static void qrs_publish (const struct qrs_event *ev) {
+    ++qrs_stats.n_beats;
+    struct qrs_beat *beat = ptc_pool_alloc (&qrs_pool);
+    if (beat == NULL) {
+	++qrs_stats.n_no_block;
+	return;
+    }
+    beat->ev = *ev;
+    beat->n_refs = QRS_N_CONSUMERS;
+    for (int c=0; c<QRS_N_CONSUMERS; ++c)
+	if (xQueueSend (qrs_queues[c], &beat, 0) != pdPASS) {
+	    ++qrs_stats.n_dropped[c];
+	    qrs_release (beat);
+	}
+}
 
-    return (r);
+// Block until the next beat for consumer 'c'.
+static void qrs_wait (int c, struct qrs_event *ev) {
+    struct qrs_beat *beat;
+    while (xQueueReceive (qrs_queues[c], &beat, portMAX_DELAY) != pdPASS)
+	;
+    *ev = beat->ev;
+    qrs_release (beat);
+    ++qrs_stats.n_received[c];
 }
 
 //****************************************************
-// Windowing algorithm
+// The PTC pipeline.
 //****************************************************
 
-// Just a running average of the last 100 samples, using a circular buffer.
-// Used by the right-side algorithm.
-#define WINDOW_SIZE 100 // samples for the running average.
-static int window_ravg (int sample) {
-    static int window_buf [WINDOW_SIZE] = { 0 };
-    static int window_ptr = 0;
-    static long window_sum = 0;
+// The whole per-sample pipeline (lowpass, left- and right-side analysis,
+// dual-QRS) lives in ptc_pipeline.hpp, specialized at compile time for our
+// sample rate; ptc_board_step() in ptc_pipeline.cpp is its C entry point. The
+// host-debug build runs the very same code.
 
-    window_sum -= window_buf[window_ptr];
-    window_buf[window_ptr] = sample;
-    window_sum += sample;
-    window_ptr = (window_ptr+1) % WINDOW_SIZE;
+//****************************************************
+// Sample acquisition.
+//****************************************************
 
-    return (window_sum / WINDOW_SIZE);
+// The ADC is sampled entirely in hardware: TIM6 triggers each conversion at
+// exactly PTC_BOARD_SAMPLE_RATE, and DMA drops the results into a circular
+// buffer of two ADC_BLOCK-sample halves (see ADC1_start_dma()). When a half
+// fills, the DMA interrupt copies it into the sample ring and wakes the main
+// loop, which drains the lot. So the CPU wakes once per block rather than
+// once per sample, and a main loop that runs late (behind a higher-priority
+// task, say) doesn't delay or lose samples; they just wait in the ring. If it
+// falls a whole ring behind, the newest samples are dropped and counted in
+// sample_ring.n_overflows (look at it with the debugger).
+#define ADC_BLOCK 16		// Samples per DMA half, i.e., per 32ms wakeup.
+#define SAMPLE_RING_SIZE 256	// Half a second at 500 Hz; a power of two.
+static uint16_t adc_dma_buf[2*ADC_BLOCK];
+static uint16_t sample_ring_buf[SAMPLE_RING_SIZE];
+static struct sample_ring sample_ring;
+static TaskHandle_t task_handle_main_loop = NULL;
+
+// Since the sample clock is TIM6, every block's release time is known to the
+// cycle, which lets sample_clock (lib_sample_clock.h) keep track, by the DWT
+// cycle counter, of how late the DMA interrupt sees each block and how long
+// after its release the main loop has finished with it. Its deadline is the
+// next block, 32ms on. Once a second the stats go out in the telemetry stream
+// as a report, which lab7_host_telemetry prints.
+static struct sample_clock sample_clock;
+
+// Half-transfer means adc_dma_buf[0..ADC_BLOCK) just filled; transfer-
+// complete means the second half did. (If we were ever so late that both
+// are pending, the first half is the older one.)
+void DMA1_Channel1_IRQHandler (void) {
+    PTC_TRACE_ISR_ENTER (PTC_TRACE_ISR_ADC_DMA);
+    uint32_t isr = DMA1->ISR;
+    DMA1->IFCR = DMA_IFCR_CGIF1;		// Clear all of channel 1's flags.
+    uint32_t now = cycle_count ();
+    if (isr & DMA_ISR_HTIF1) {
+	sample_ring_push_block (&sample_ring, adc_dma_buf, ADC_BLOCK);
+	sample_clock_arrived (&sample_clock, now);
+    }
+    if (isr & DMA_ISR_TCIF1) {
+	sample_ring_push_block (&sample_ring, adc_dma_buf+ADC_BLOCK, ADC_BLOCK);
+	sample_clock_arrived (&sample_clock, now);
+    }
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR (task_handle_main_loop, &woken);
+    PTC_TRACE_ISR_EXIT (PTC_TRACE_ISR_ADC_DMA);
+    portYIELD_FROM_ISR (woken);
 }
 
-//****************************************************
-// The moving-threshold algorithm, used as the near-final stage of the left-side
-// and right-side calculations.
-//****************************************************
+// Every sample's pipeline signals also go out of USART2 (the ST-Link's
+// virtual COM port, so it's the USB cable) as telemetry frames (see
+// lib_telemetry.h), for lab7_host_telemetry to turn into a trace on a laptop.
+// That takes a fifth of the link at 1 Mbaud. The UART's DMA does the
+// sending; if it ever falls a whole ring behind, frames are dropped (and
+// counted by serial_tx_dropped()), which the decoder sees as gaps in seq.
+#define TELEMETRY_BAUD 1000000
+static uint16_t telemetry_seq = 0;
+
+// Send the sample clock's stats as a telemetry report. It's only the main
+// loop that calls this, so the buffers can be static rather than on its
+// stack.
+static void send_clock_report (void) {
+    static struct sample_clock_stats stats;
+    static uint32_t words[SAMPLE_CLOCK_N_WORDS];
+    static uint8_t report[PTC_TLM_REPORT_SIZE (SAMPLE_CLOCK_N_WORDS)];
+    taskENTER_CRITICAL ();		// Hold off the DMA interrupt.
+    sample_clock_get_stats (&sample_clock, &stats);
+    taskEXIT_CRITICAL ();
+    sample_clock_stats_to_words (&stats, words);
+    uint32_t n = ptc_tlm_pack_report (report, PTC_TLM_REPORT_CLOCK, words,
+				      SAMPLE_CLOCK_N_WORDS);
+    serial_write_nb (USART2, report, n);
+}
 
-struct threshold_state {
-    int threshold; // running peak threshold
-    int max, min;
-    int decay; // amount that max and min thresholds decay each sample
-};
-struct threshold_state threshold_state_1 = { 0x7FF, 0x000, 0xFFF, 15 };
-struct threshold_state threshold_state_2 = { 0x7FF, 0x000, 0x2FF, 4 };
-
-// The moving-threshold algorithm.
-// It always keeps a running min & running max. Each time we get a new sample
-// (and hence call this function)...
-//    - A negative sample is the exception; immediately return the current
-//	threshold (which is (min+max)/2).
-//    - The new sample goes into the running min & max.
-//    -	The max decrements by a fixed delta, and the min increments by the
-//	same fixed delta. Clamp the max to never go <0, and the min to never
-//	go >0xFFF.
-//    - Return (min + max)/2
-// Does it really make sense to have max < min??? This algorithm allows that!
-// And note that this algorithm is completely different than Pan Tompkins.
-int threshold( struct threshold_state * state, int psample ) {
-    if (psample <= 0) return (state->threshold); // no sample peak
-
-    if (psample > state->max) state->max = psample;
-    if (psample < state->min) state->min = psample;
-
-    // Implement decay.
-    state->max -= state->decay;
-    if (state->max < 0x000) state->max = 0x000;
-    state->min += state->decay;
-    if (state->min > 0xFFF) state->min = 0xFFF;
-
-    state->threshold = (state->min + state->max)/2;
-    return (state->threshold);
+// The host can ask for more than the telemetry stream carries by itself,
+// by sending a command byte down USART2 (e.g., echo p > /dev/ttyACM0):
+//	p  The main loop times each of its stages, and the pipeline's, with
+//	   the DWT cycle counter (see lib_profile.h), and keeps the stats in
+//	   RAM. This sends them.
+//	r  Starts the profile over.
+//	t  The kernel's trace hooks record the scheduler's doings into a ring
+//	   (see lib_trace.h). This freezes it and sends it.
+// Only the nucleo_l432kc-profile build (see platformio.ini, which defines
+// PTC_PROFILE and PTC_TRACE for it) has these; the plain one ignores them.
+// Either goes out in the telemetry stream as reports, one per block so as not
+// to crowd out the sample frames, for lab7_host_telemetry.
+static volatile uint8_t host_command = 0;	// From the USART2 interrupt.
+
+static void on_host_byte (void *arg, uint8_t byte) {
+    host_command = byte;
 }
 
-struct compute_peak_state {
-    struct deriv_5pt_state der5_state;
-    int prev_deriv;
-};
+// Send words[n] as a report; false if there isn't room in the UART's ring
+// just now. Only the main loop sends reports, so one buffer does.
+static bool send_report (uint8_t type, const uint32_t *words, uint32_t n) {
+    static uint8_t report[PTC_TLM_MAX_REPORT_SIZE];
+    return (serial_write_nb (USART2, report,
+			     ptc_tlm_pack_report (report, type, words, n)));
+}
 
-// Usually return 0; but when the input signal hits a peak, then return the
-// value of the signal (i.e., of the peak).
-int compute_peak (int sample, struct compute_peak_state *state) {
-    // First compute the derivative.
-    int deriv = deriv_5pt (sample, &state->der5_state);
+// Carry out the host's latest command, and send the next piece of any dump
+// that's under way.
+static void serve_host (void) {
+    static uint32_t words[PTC_TLM_MAX_WORDS];
+    uint8_t command = __atomic_exchange_n (&host_command, 0, __ATOMIC_RELAXED);
+    (void) words;
+    (void) command;
+
+#ifdef PTC_PROFILE
+    static int prof_stage = -1;		// The next stage to send; -1 if none.
+    if (command == 'r')
+	ptc_prof_reset ();
+    else if (command == 'p')
+	prof_stage = 0;
+    if (prof_stage >= 0) {
+	ptc_prof_to_words (prof_stage, words);
+	if (send_report (PTC_TLM_REPORT_PROFILE, words, PTC_PROF_N_WORDS)
+	    && (++prof_stage == PTC_PROF_N_STAGES))	// Else try next time.
+	    prof_stage = -1;
+    }
+#endif
+
+#ifdef PTC_TRACE
+    static int trace_next = -2;		// The next event to send, -1 for the
+					// info, -2 if none.
+    if ((command == 't') && (trace_next == -2)) {
+	ptc_trace_freeze (true);
+	trace_next = -1;
+    }
+    if (trace_next == -1) {
+	uint32_t n = ptc_trace_info_words (words);
+	if (send_report (PTC_TLM_REPORT_TRACE_INFO, words, n))
+	    trace_next = 0;
+    } else if (trace_next >= 0) {
+	uint32_t n = ptc_trace_chunk_words (trace_next, words);
+	if (n == 1) {				// Past the end.
+	    ptc_trace_freeze (false);
+	    trace_next = -2;
+	} else if (send_report (PTC_TLM_REPORT_TRACE, words, n))
+	    trace_next += (n-1) / 2;
+    }
+#endif
+}
 
-    // Peak==1 if the current sample fell and the previous one rose. I.e., we
-    // just had a peak.
-    bool peak = (state->prev_deriv>=0) && (deriv<0);
-    state->prev_deriv = deriv; // update derivative history
+// Every few seconds, the memory report (lib_memory.h): how much of its stack
+// each task has left at worst (the kernel paints the stacks when it creates
+// the tasks, and looks for the deepest paint that's been overwritten), and,
+// if we're built with a heap, how full and fragmented it is. The stacks'
+// sizes are hand picked, so this is how we know how much we can trim them.
+#define MEMORY_REPORT_SECONDS 5
+#define STACK_BLINK_GRN		128	// Words.
+#define STACK_MAIN_LOOP		256
+#define STACK_BEEP		100
+#define STACK_DISPLAYBPM	100
+static struct {
+    TaskHandle_t handle;
+    uint32_t stack_words;
+} stacks[PTC_MEM_MAX_TASKS];
+static uint32_t n_stacks = 0;
+
+// Have the memory report watch a task's stack.
+static void watch_stack (TaskHandle_t handle, uint32_t stack_words) {
+    if (n_stacks < PTC_MEM_MAX_TASKS) {
+	stacks[n_stacks].handle = handle;
+	stacks[n_stacks].stack_words = stack_words;
+	++n_stacks;
+    }
+}
 
-    // We'll usually return 0, but data if we just had a peak.
-    return (peak? sample : 0);
+static void send_memory_report (void) {
+    static struct ptc_mem_report r;
+    static uint32_t words[PTC_MEM_MAX_WORDS];
+    r.n_tasks = 0;
+    TaskHandle_t idle = xTaskGetIdleTaskHandle ();
+    ptc_mem_add_task (&r, uxTaskGetTaskNumber (idle), pcTaskGetName (idle),
+		      configMINIMAL_STACK_SIZE,
+		      uxTaskGetStackHighWaterMark (idle));
+    for (uint32_t i=0; i<n_stacks; ++i)
+	ptc_mem_add_task (&r, uxTaskGetTaskNumber (stacks[i].handle),
+			  pcTaskGetName (stacks[i].handle),
+			  stacks[i].stack_words,
+			  uxTaskGetStackHighWaterMark (stacks[i].handle));
+    r.n_pools = 0;
+    ptc_mem_add_pool (&r, &qrs_pool);
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+    HeapStats_t hs;
+    vPortGetHeapStats (&hs);
+    r.have_heap = true;
+    r.heap.total = configTOTAL_HEAP_SIZE;
+    r.heap.free = hs.xAvailableHeapSpaceInBytes;
+    r.heap.min_free = hs.xMinimumEverFreeBytesRemaining;
+    r.heap.largest_free = hs.xSizeOfLargestFreeBlockInBytes;
+    r.heap.smallest_free = hs.xSizeOfSmallestFreeBlockInBytes;
+    r.heap.n_free_blocks = hs.xNumberOfFreeBlocks;
+    r.heap.n_allocs = hs.xNumberOfSuccessfulAllocations;
+    r.heap.n_frees = hs.xNumberOfSuccessfulFrees;
+#else
+    r.have_heap = false;
+#endif
+    send_report (PTC_TLM_REPORT_MEMORY, words, ptc_mem_to_words (&r, words));
 }
 
-#define READ_WRITE_DELAY ( 2 / portTICK_PERIOD_MS ) // sample at 500 Hz
-#define REFRACTORY_TICKS 100 // 200 ms at 500 Hz
-// Schedule this task every 2ms.
+// Runs whenever the acquisition ISR has a block of samples for us.
 void task_main_loop (void *pvParameters) {
-    int sample_count=0;	// To ignore startup artifacts.
-    // Refractory_counter is zeroed at dual_QRS falling edge, and counts up each
-    // tick after that. It's to ignore new peaks too close to an existing one.
-    int refractory_counter = 0;
-    struct compute_peak_state peak_state_1, peak_state_2;
+    if (!ptc_board_init ())
+	error ("Cannot quantize the lowpass filter");
+    uint32_t n_samples = 0, last_qrs = 0, last_report = 0;
+    uint32_t last_memory_report = 0;
+    bool any_qrs = false;
 
     for ( ;; ) {
-	vTaskDelay (READ_WRITE_DELAY);
-
-	// Read ADC, using a spin-wait loop.
-	uint32_t sample = analogRead (A0);
-	//sample *= 2;
-	uint8_t dac_output = sample >> 4;
-	//dac_output *= 2;
-	analogWrite (A4, dac_output);
-
-	// Run it through one or more cascaded biquads.
-	int filtered = sample;
-	for (int i=0; i<N_BIQUAD_SECS; ++i)
-	    filtered = biquad(&biquad_20Hz_lowpass[i],
-			      &biquad_state[i], filtered, 12);
-
-	// Left-side analysis
-	// Peak_1 is usually 0; but when the bandpass-filtered signal hits a
-	// peak, then peak_1 is the bandpass-filtered signal.
-	int peak_1   = compute_peak (filtered, &peak_state_1);
-	int thresh_1 = threshold (&threshold_state_1, peak_1);
-
-	// Right-side processing
-	// Fancy 5-point derivative of the bandpass-filtered signal.
-	int deriv_2 = deriv_5pt (filtered, &deriv_5pt_state);
-	int deriv_sq_2 = deriv_2 * deriv_2;
-	uint8_t deriv_2_out = (deriv_2 + 2048) >> 4;
-	analogWrite (A4, deriv_2_out);
-
-	// Running_avg over a 200ms window.
-	int avg_200ms_2 = window_ravg(deriv_sq_2);
-
-	// Right-side analysis
-	int peak_2 = compute_peak (avg_200ms_2, &peak_state_2);
-	if (++sample_count < 250) continue;
-	int thresh_2 = threshold (&threshold_state_2, peak_2);
-
-	// Dual-QRS calculation combining left & right sides.
-	dual_QRS_last = dual_QRS;	// pipe stage for edge detect.
-	++refractory_counter;
-	dual_QRS = (filtered > thresh_1) && (avg_200ms_2 > thresh_2)
-		&& (refractory_counter > REFRACTORY_TICKS);
-	if (dual_QRS_last && !dual_QRS) refractory_counter = 0;
-	// Write to DAC 2, which drives Nano pin A4.
-	//analogWrite (A4, dual_QRS);
+	ulTaskNotifyTake (pdTRUE, portMAX_DELAY);
+
+	uint16_t block[ADC_BLOCK];
+	for ( ;; ) {
+	    PTC_PROF_START (t_block);
+	    PTC_PROF_START (t_acquire);
+	    uint32_t n = sample_ring_pop_block (&sample_ring, block, ADC_BLOCK);
+	    if (n == 0)
+		break;
+	    PTC_PROF_END (t_acquire, PTC_PROF_ACQUIRE, n);
+
+	    for (uint32_t i=0; i<n; ++i, ++n_samples) {
+		uint32_t sample = block[i];
+		//sample *= 2;
+		uint8_t dac_output = sample >> 4;
+		//dac_output *= 2;
+		analogWrite (A4, dac_output);
+
+		struct ptc_tick tick;
+		PTC_PROF_START (t_sample);
+		ptc_board_step (sample, &tick);
+		PTC_PROF_LAP (t_sample, PTC_PROF_PIPELINE);
+
+		uint8_t frame[PTC_TLM_FRAME_SIZE];
+		ptc_tlm_pack (frame, telemetry_seq++, sample, &tick);
+		serial_write_nb (USART2, frame, sizeof frame);
+
+		// Show the right-side derivative on DAC 2.
+		uint8_t deriv_2_out = (tick.deriv_2 + 2048) >> 4;
+		analogWrite (A4, deriv_2_out);
+		PTC_PROF_END (t_sample, PTC_PROF_OUTPUT, 1);
+
+		if (!tick.warm) continue;	// Ignore startup artifacts.
+
+		// Dual-QRS calculation combining left & right sides.
+		if (tick.dual_QRS_rise) {
+		    struct qrs_event ev = { n_samples,
+					    any_qrs ? n_samples - last_qrs : 0,
+					    tick.peak_2 };
+		    qrs_publish (&ev);
+		    last_qrs = n_samples;
+		    any_qrs = true;
+		}
+		// Write to DAC 2, which drives Nano pin A4.
+		//analogWrite (A4, tick.dual_QRS);
+	    }
+
+	    // Done with this block; dropped samples count as delivered.
+	    struct sample_ring_stats ring_stats;
+	    sample_ring_get_stats (&sample_ring, &ring_stats);
+	    sample_clock_done (&sample_clock, cycle_count (),
+			       n_samples + ring_stats.n_overflows);
+	    if (n_samples - last_report >= PTC_BOARD_SAMPLE_RATE) {
+		send_clock_report ();
+		last_report = n_samples;
+	    }
+	    if (n_samples - last_memory_report
+		>= MEMORY_REPORT_SECONDS * PTC_BOARD_SAMPLE_RATE) {
+		send_memory_report ();
+		last_memory_report = n_samples;
+	    }
+	    PTC_PROF_END (t_block, PTC_PROF_BLOCK, n);
+	    PTC_PROF_NEXT_LEVEL ();
+	    serve_host ();
+	}
     }
 }
 
@@ -247,37 +410,37 @@ void task_blink_grn (void *pvParameters) {
     }
 }
 
-// 250Hz beep.
-// Flag the dual_QRS leading edge. When that happens...
-// - Flip the GPIO pin every 4 ticks (4ms)
-// - Stop after 100 ticks.
-// So we get an 8ms period (125Hz) beep for 100ms.
+// Beep for each QRS: flip the GPIO pin every 4 ticks (4ms), for 96 ticks.
+// So we get an 8ms period (125Hz) beep for ~100ms.
+#define BEEP_HALF_PERIOD 4	// Ticks.
+#define BEEP_TICKS 96
 void task_beep (void *pvParameters) {
     int val=0;
-    int dual_QRS_last=0;
-    int beep_counter=0;
     for ( ;; ) {
-	if (dual_QRS && !dual_QRS_last)
-	    beep_counter = 1;
-	// Flip the GPIO pin every 4 ticks. We write a 1 at counter=4, 0 at
-	// counter=8, etc.
-	if ((beep_counter>0) && (beep_counter&0x3)==0) {
+	struct qrs_event ev;
+	qrs_wait (QRS_BEEP, &ev);
+	for (int t=0; t<BEEP_TICKS; t+=BEEP_HALF_PERIOD) {
+	    vTaskDelay (BEEP_HALF_PERIOD);
 	    val = !val;
 	    digitalWrite (D2, val);	// The buzzer is on Nano D2, or PA12.
 	}
-	// And turn off the beep after 100 ticks.
-	if ((beep_counter>0) && (beep_counter++==96))
-	    beep_counter = 0;
-	dual_QRS_last=dual_QRS;
-	vTaskDelay(1);
     }
 }
 
-void USART_write_byte (unsigned char c) {
-    static char buf[2];
-    buf[0]=c;
-    buf[1]='\0';
-    serial_write (USART1, buf);
+// The LCD is on USART1 at 9600 baud, so a display update takes ~7ms on the
+// wire. Rather than have the display task sit through that, we build each
+// update up here and queue it for the UART's DMA in one go (see
+// serial_write_nb()). If the previous update somehow hasn't gone yet, the
+// new one is just dropped.
+static uint8_t LCD_buf[8];
+static uint32_t LCD_len = 0;
+static void LCD_byte (unsigned char c) {
+    if (LCD_len < sizeof LCD_buf)
+	LCD_buf[LCD_len++] = c;
+}
+static void LCD_send (void) {
+    serial_write_nb (USART1, LCD_buf, LCD_len);
+    LCD_len = 0;
 }
 
 // Output a float in [0,999.9] to a 4-digit LCD.
@@ -286,11 +449,12 @@ static void float_to_LCD (float f) {
     // and one to the right.
     int number = f*10 + .5;
 
-    USART_write_byte (0x76);		// Clear display, set cursor to pos 0
+    LCD_byte (0x76);		// Clear display, set cursor to pos 0
 
     if (number > 9999) {			// Detect overflow (print "OF").
-	USART_write_byte ('0');
-	USART_write_byte ('F');
+	LCD_byte ('0');
+	LCD_byte ('F');
+	LCD_send ();
 	return;
     }
 
@@ -306,58 +470,79 @@ static void float_to_LCD (float f) {
 		all_zeros_so_far &= (i==0);
 		// Output the digit (i);
 		if (all_zeros_so_far)
-		    USART_write_byte (0x20);	// Space, not leading 0
+		    LCD_byte (0x20);	// Space, not leading 0
 		else
-		    USART_write_byte ('0'+i);
+		    LCD_byte ('0'+i);
 
 		break;	// on to the next LSB-most position.
 	    }
 	}
     }
-    USART_write_byte (0x77);	// Command to write decimal point(s) or colon...
-    USART_write_byte (0x04);	// ... and write the 2nd decimal point
+    LCD_byte (0x77);	// Command to write decimal point(s) or colon...
+    LCD_byte (0x04);	// ... and write the 2nd decimal point
+    LCD_send ();
 }
 
 void task_displaybpm(void *pvParameters) {
-    static TickType_t last_new_beat=0;
     for ( ;; ) {
-	if (!dual_QRS_last && dual_QRS) {	// for every *new* heartbeat...
-	    TickType_t time = xTaskGetTickCount();
-	    // Convert time in milisec to beats/minute.
-	    float bpm = 60.0f * 1000.0f / (time - last_new_beat);
-	    float_to_LCD (bpm);
-	    last_new_beat = time;
-	}
-	vTaskDelay (1);
+	struct qrs_event ev;
+	qrs_wait (QRS_DISPLAY, &ev);	// For every *new* heartbeat...
+	if (ev.rr == 0)
+	    continue;			// (The first has nothing to go on.)
+	// Convert the RR interval in samples to beats/minute.
+	float bpm = 60.0f * PTC_BOARD_SAMPLE_RATE / ev.rr;
+	float_to_LCD (bpm);
     }
 }
 
-#define TICKS_PER_PT 2	// Typically 500 Hz sampling, so TICKS_PER_PT=2
+#define CANNED_ECG_RATE 500	// Hz; the rate it was recorded at.
 #define ECG_DATA_FILE "ecg_normal_board_calm1.txt"
-static unsigned short int ECG_data[] = {
+static const uint16_t ECG_data[] = {
 #include ECG_DATA_FILE
 };
 
-// Write a canned ECG out on DAC 1, which drives PA4 (Nano A3).
-// Note that the ADC is 12 bits but the DAC is 8 bits, so we do a 4-bit right
-// shift before the analog write.
-void task_canned_ECG (void *pvParameters) {
-    int n_datapoints = (sizeof ECG_data) / (sizeof (short int));
-
-    int i=0;
-    while (1) {
-	if (++i == n_datapoints)
-	    i = 0;
-	//unsigned int data = (ECG_data[i]-1300) >> 3;
-	unsigned int data = ECG_data[i] >> 4;
-	analogWrite (A3, data);
-	if (data > 0xFF) {
-	    analogWrite (A3, 0xFF);
+// Loop the canned ECG out of DAC 1, which drives PA4 (Nano A3), at its full
+// 12 bits. It's paced by TIM7 and fed by DMA straight from flash, so once
+// it's started, no task or interrupt touches it, and its timing doesn't
+// depend on how busy the scheduler is.
+static void start_canned_ECG (void) {
+    int n_datapoints = (sizeof ECG_data) / (sizeof ECG_data[0]);
+    for (int i=0; i<n_datapoints; ++i)
+	if (ECG_data[i] > 0xFFF)
 	    error ("Canned data is out of range");
-	}
-	vTaskDelay(TICKS_PER_PT);
-    }
+    DAC1_start_dma (ECG_data, n_datapoints, CANNED_ECG_RATE);
+}
+
+// Everything the kernel needs is allocated here, at link time, rather than
+// from a heap (configSUPPORT_DYNAMIC_ALLOCATION is 0, and heap_4.c isn't
+// built): each task's control block and stack, and the idle task's. So the
+// linker map shows all the RAM we use, and creating the tasks can't fail.
+static StaticTask_t tcb_blink_grn, tcb_main_loop, tcb_beep, tcb_displaybpm;
+static StackType_t stack_blink_grn[STACK_BLINK_GRN];
+static StackType_t stack_main_loop[STACK_MAIN_LOOP];
+static StackType_t stack_beep[STACK_BEEP];
+static StackType_t stack_displaybpm[STACK_DISPLAYBPM];
+
+void vApplicationGetIdleTaskMemory (StaticTask_t **tcb, StackType_t **stack,
+				     uint32_t *stack_words) {
+    static StaticTask_t idle_tcb;
+    static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+    *tcb = &idle_tcb;
+    *stack = idle_stack;
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+#if (configUSE_TIMERS == 1)
+// We don't use software timers, but if we ever do, their task needs the same.
+void vApplicationGetTimerTaskMemory (StaticTask_t **tcb, StackType_t **stack,
+				      uint32_t *stack_words) {
+    static StaticTask_t timer_tcb;
+    static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+    *tcb = &timer_tcb;
+    *stack = timer_stack;
+    *stack_words = configTIMER_TASK_STACK_DEPTH;
 }
+#endif
 
 int main() {
     clock_setup_80MHz();
@@ -370,57 +555,83 @@ int main() {
     pinMode(D2, "OUTPUT");
     pinMode(D6, "OUTPUT");
 
-    // We use the UART to talk to the 7-segment display. Initialize the UART,
-    // and kick off the display with any old value.
-    serial_begin (USART1);
+    // We use the UART to talk to the 7-segment display. Initialize the UART
+    // (for DMA-driven writes, so that the display never holds up a task), and
+    // kick off the display with any old value.
+    serial_begin_nb (USART1, 9600,
+		     configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
     float_to_LCD (40.2);
 
+    // The telemetry stream.
+    serial_begin_nb (USART2, TELEMETRY_BAUD,
+		     configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    serial_on_rx (USART2, on_host_byte, NULL,
+		  configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+
+    // Set up the sample ring; the acquisition itself starts just before the
+    // scheduler does.
+    if (!sample_ring_init (&sample_ring, sample_ring_buf, SAMPLE_RING_SIZE))
+	error ("Sample ring size must be a power of two");
+    cycle_counter_start ();
+    if (!sample_clock_init (&sample_clock, PTC_BOARD_SAMPLE_RATE, ADC_BLOCK,
+			    SystemCoreClock / 1000000))
+	error ("The sample clock's block period isn't a whole number of cycles");
+
+    // The QRS event queues, which the tasks below wait on, and the pool the
+    // events come from.
+    if (!ptc_pool_init (&qrs_pool, qrs_pool_storage, sizeof (struct qrs_beat),
+			QRS_N_BEATS))
+	error ("Cannot set up the QRS event pool");
+    for (int c=0; c<QRS_N_CONSUMERS; ++c) {
+	qrs_queues[c] = xQueueCreateStatic (QRS_QUEUE_LEN,
+					    sizeof (struct qrs_beat *),
+					    qrs_queue_storage[c],
+					    &qrs_queue_structs[c]);
+	vQueueSetQueueNumber (qrs_queues[c], c+1);	// For the trace.
+    }
+
     // Create tasks.
-    TaskHandle_t task_handle_grn = NULL;
-    BaseType_t status = xTaskCreate	(
+    TaskHandle_t task_handle_grn = xTaskCreateStatic (
 	task_blink_grn, "Blink Red LED",
-	128, // stack size in words
+	STACK_BLINK_GRN, // stack size in words
 	NULL, // parameter passed into task, e.g. "(void *) 1"
 	tskIDLE_PRIORITY+2, // priority
-	&task_handle_grn);
-    if (status != pdPASS) error ("Cannot create blink-green task");
+	stack_blink_grn, &tcb_blink_grn);
+    watch_stack (task_handle_grn, STACK_BLINK_GRN);
 
-    TaskHandle_t task_handle_main_loop = NULL;
-    status = xTaskCreate (
+    task_handle_main_loop = xTaskCreateStatic (
 	task_main_loop,
 	"Main loop",
-	256, // stack size in words
+	STACK_MAIN_LOOP, // stack size in words
 	NULL, // parameter passed into task, e.g. "(void *) 1"
 	tskIDLE_PRIORITY+1, // priority
-	&task_handle_main_loop);
-    if (status != pdPASS) error ("Cannot create main-loop task");
+	stack_main_loop, &tcb_main_loop);
+    watch_stack (task_handle_main_loop, STACK_MAIN_LOOP);
 
-    TaskHandle_t task_handle_beep = NULL;
-    status = xTaskCreate (
+    TaskHandle_t task_handle_beep = xTaskCreateStatic (
 	    task_beep, "Beep Piezo Buzzer",
-	    100, // stack size in words
+	    STACK_BEEP, // stack size in words
 	    NULL, // parameter passed into task, e.g. "(void *) 1"
 	    tskIDLE_PRIORITY, // priority
-	    &task_handle_beep);
-    if (status != pdPASS) error ("Cannot create beep task");
+	    stack_beep, &tcb_beep);
+    watch_stack (task_handle_beep, STACK_BEEP);
 
-    TaskHandle_t task_handle_displaybpm = NULL;
-    status = xTaskCreate (
+    TaskHandle_t task_handle_displaybpm = xTaskCreateStatic (
 	    task_displaybpm, "Display BPM",
-	    100, // stack size in words
+	    STACK_DISPLAYBPM, // stack size in words
 	    NULL, // parameter passed into task, e.g. "(void *) 1"
 	    tskIDLE_PRIORITY, // priority
-	    &task_handle_displaybpm);
-    if (status != pdPASS) error ("Cannot create display-BPM task");
+	    stack_displaybpm, &tcb_displaybpm);
+    watch_stack (task_handle_displaybpm, STACK_DISPLAYBPM);
 
-    TaskHandle_t task_handle_canned_ECG = NULL;
-    status = xTaskCreate (
-	task_canned_ECG, "Task to drive a canned ECG out to PA3",
-	100, // stack size in words
-	NULL, // parameter passed into task, e.g. "(void *) 1"
-	tskIDLE_PRIORITY+2, // priority
-	&task_handle_canned_ECG);
-    if (status != pdPASS) error ("Cannot create drive-ECG task");
+    start_canned_ECG ();
+
+    // Start sampling. The first DMA interrupt comes ADC_BLOCK samples from
+    // now, by which time the main loop is waiting for it.
+    ADC_Init ();
+    sample_clock_start (&sample_clock, cycle_count ());
+    ADC1_start_dma (adc_dma_buf, 2*ADC_BLOCK, PTC_BOARD_SAMPLE_RATE,
+		    configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
 
     vTaskStartScheduler();
 }
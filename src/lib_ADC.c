@@ -228,6 +228,67 @@ uint32_t ADC1_read (void) {
     return (ADC1->DR);
 }
 
+//**************************************************************************
+// Timer-triggered, DMA double-buffered acquisition.
+// TIM6 overflows at exactly 'rate_hz' and its TRGO (update event) starts
+// each ADC1 conversion in hardware, so the sampling has no software jitter
+// at all. DMA1 channel 1 (request 0 = ADC1) copies each result from ADC1->DR
+// into buf[n], circularly. It interrupts at the half-transfer point (when
+// buf[0..n/2) is full) and at transfer-complete (buf[n/2..n)), and then
+// carries on into the other half; so DMA1_Channel1_IRQHandler() (which you
+// supply) has n/2 sample times to copy out the half that just filled. The
+// CPU does nothing per sample.
+// ADC_Init() must have been called first. 'priority' is the NVIC priority
+// for the DMA interrupt; if its handler calls the FreeRTOS ...FromISR()
+// functions, it must be numerically at or above
+// configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY.
+//**************************************************************************
+void ADC1_start_dma (uint16_t *buf, uint32_t n, uint32_t rate_hz,
+		     uint32_t priority) {
+    if ((n < 2) || (n & 1))
+	error ("Bad ADC DMA buffer size");
+
+    // The ADC must be idle (ADSTART=0) while we change CFGR.
+    if (ADC1->CR & ADC_CR_ADSTART) {
+	ADC1->CR |= ADC_CR_ADSTP;
+	while (ADC1->CR & ADC_CR_ADSTP)
+	    ;
+    }
+
+    // DMA1 channel 1: peripheral ADC1->DR to memory, 16 bits each way,
+    // memory-increment, circular, interrupts at half & full transfer.
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+    DMA1_Channel1->CCR &= ~DMA_CCR_EN;		// Can only set up when off.
+    DMA1_CSELR->CSELR &= ~DMA_CSELR_C1S;	// Request 0000 is ADC1.
+    DMA1_Channel1->CPAR  = (uint32_t) &ADC1->DR;
+    DMA1_Channel1->CMAR  = (uint32_t) buf;
+    DMA1_Channel1->CNDTR = n;
+    DMA1_Channel1->CCR = DMA_CCR_PL_1		// High priority
+		       | DMA_CCR_MSIZE_0	// 16-bit memory
+		       | DMA_CCR_PSIZE_0	// 16-bit peripheral
+		       | DMA_CCR_MINC | DMA_CCR_CIRC
+		       | DMA_CCR_HTIE | DMA_CCR_TCIE;
+    DMA1->IFCR = DMA_IFCR_CGIF1;		// Clear any stale flags.
+    NVIC_SetPriority (DMA1_Channel1_IRQn, priority);
+    NVIC_EnableIRQ (DMA1_Channel1_IRQn);
+    DMA1_Channel1->CCR |= DMA_CCR_EN;
+
+    // ADC1: hardware trigger on the rising edge of EXTSEL=1101 (TIM6_TRGO),
+    // one conversion per trigger, and DMA in circular mode (DMACFG=1), so
+    // that it keeps issuing DMA requests after the first CNDTR of them.
+    ADC1->CFGR &= ~(ADC_CFGR_EXTSEL | ADC_CFGR_EXTEN | ADC_CFGR_CONT);
+    ADC1->CFGR |= (13U << ADC_CFGR_EXTSEL_Pos) | ADC_CFGR_EXTEN_0
+		| ADC_CFGR_DMAEN | ADC_CFGR_DMACFG;
+
+    basic_timer_init (TIM6, rate_hz);
+
+    // Arm the ADC (with EXTEN set, ADSTART just waits for triggers), then
+    // start the timer.
+    ADC1->ISR = ADC_ISR_EOC | ADC_ISR_OVR;
+    ADC1->CR |= ADC_CR_ADSTART;
+    TIM6->CR1 |= TIM_CR1_CEN;
+}
+
 uint32_t analogRead(enum Pin pin) {
     enum Pin current_pin=D13;		// initialize to an illegal pin.
     static bool ADC_enabled = 0;
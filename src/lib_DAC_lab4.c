@@ -93,6 +93,46 @@ void DAC2_write (uint32_t data) {
     DAC->DHR12R2 = data;
 }
 
+// Play buf[n] out of DAC 1 (PA4, Nano A3) over and over, one 12-bit sample
+// every 1/rate_hz seconds, with no CPU involvement at all once started.
+// TIM7 is the sample clock: each TRGO (DAC_CR.TSEL1=010) moves DHR12R1 to
+// the output and requests the next sample from DMA1 channel 3 (request 0110
+// is DAC_CH1), which runs circularly over buf[]. The buffer can be in flash.
+// There are no interrupts, so nothing here for you to supply. After this,
+// don't use analogWrite(A3, ...) or DAC1_write(); they'd just be overwritten
+// on the next tick.
+void DAC1_start_dma (const uint16_t *buf, uint32_t n, uint32_t rate_hz) {
+    if (n == 0)
+	error ("Empty DAC DMA buffer");
+    DAC1_Init ();
+
+    // DMA1 channel 3: memory to peripheral (DIR=1), memory-increment,
+    // circular. The DAC registers want 32-bit accesses, so the peripheral
+    // size is 32 bits; the DMA zero-extends each 16-bit sample.
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+    DMA1_Channel3->CCR &= ~DMA_CCR_EN;		// Can only set up when off.
+    DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_C3S)
+		      | (6U << DMA_CSELR_C3S_Pos);
+    DMA1_Channel3->CPAR  = (uint32_t) &DAC->DHR12R1;
+    DMA1_Channel3->CMAR  = (uint32_t) buf;
+    DMA1_Channel3->CNDTR = n;
+    DMA1_Channel3->CCR = DMA_CCR_PL_0		// Medium priority
+		       | DMA_CCR_MSIZE_0	// 16-bit memory
+		       | DMA_CCR_PSIZE_1	// 32-bit peripheral
+		       | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR;
+    DMA1_Channel3->CCR |= DMA_CCR_EN;
+
+    // TSEL1 and TEN1 can only change while the channel is off.
+    DAC->CR &= ~DAC_CR_EN1;
+    DAC->CR = (DAC->CR & ~DAC_CR_TSEL1) | DAC_CR_TSEL1_1   // 010: TIM7_TRGO
+	    | DAC_CR_TEN1 | DAC_CR_DMAEN1;
+    DAC->DHR12R1 = buf[0];	// Output until the first trigger.
+    DAC->CR |= DAC_CR_EN1;
+
+    basic_timer_init (TIM7, rate_hz);
+    TIM7->CR1 |= TIM_CR1_CEN;
+}
+
 // This is the Arduino API.
 // Most Arduino boards don't have a DAC; so on those boards, this function
 // actually does a PWM on a digital GPIO pin. But it's true analog on the few
@@ -6,6 +6,7 @@ static void USART_Init (USART_TypeDef *USARTx, bool tx_en, bool rx_en,int baud);
 static void UART1_GPIO_Init(void);
 static void UART2_GPIO_Init(void);
 static void USART_Delay(uint32_t us);
+static bool serial_write_queued (USART_TypeDef *USARTx, const char *buffer);
 
 // These used to be public functions, but are now replaced with the Arduino API.
 // They're now what the Arduino API is built out of, so they're static.
@@ -198,6 +199,10 @@ static void USART_Delay(uint32_t us) {
 // Very basic function: send a character string to the UART, one byte at a time.
 // Spin wait after each byte until the UART is ready for the next byte.
 void serial_write (USART_TypeDef *USARTx, const char *buffer) {
+    // If the UART is set up for DMA, the bytes go through its ring instead.
+    if (serial_write_queued (USARTx, buffer))
+	return;
+
     // The main flag we use is Tx Empty (TXE). The HW sets it when the
     // transmit data register (TDR) is ready for more data. TXE is then
     // cleared when we write new data in (by a write to the USART_DR reg).
@@ -213,9 +218,18 @@ void serial_write (USART_TypeDef *USARTx, const char *buffer) {
 
 // Why isn't the baud rate a function parameter of serial_begin()? Because
 // that's not how Arduino specced it. Why isn't it an optional parameter
-// defaulting to 9600? Because C doesn't support default parameters.
+// defaulting to 9600? Because C doesn't support default parameters. So
+// there's serial_begin_baud() for everything else.
 void serial_begin (USART_TypeDef *USARTx) {
-    int baud=9600;
+    serial_begin_baud (USARTx, 9600);
+}
+
+// With 16x oversampling, BRR = SystemCoreClock/baud must be at least 16; so
+// at 80 MHz, we top out at 5 Mbaud.
+void serial_begin_baud (USART_TypeDef *USARTx, int baud) {
+    extern uint32_t SystemCoreClock;
+    if ((baud <= 0) || (SystemCoreClock / baud < 16))
+	error ("Unsupported baud rate");
     if (USARTx == USART1)
 	UART1_Init (baud);
     else if (USARTx == USART2)
@@ -224,6 +238,188 @@ void serial_begin (USART_TypeDef *USARTx) {
 	error ("Initializing an illegal UART");
 }
 
+/////////////////////////////////////////////
+// Non-blocking, DMA-driven transmit.
+/////////////////////////////////////////////
+
+// Each UART that's been through serial_begin_nb() has a ring of bytes waiting
+// to go out. serial_write_nb() copies its bytes in and returns at once; DMA
+// feeds them from the ring to the UART. A DMA transfer covers the contiguous
+// run of queued bytes from 'tail' (so at most up to the end of the ring);
+// when it finishes, the DMA interrupt retires those bytes and starts on
+// whatever has been queued since. When there's nothing left, the transmitter
+// goes idle and the 'done' callback (if any) runs, from the interrupt.
+// head and tail count bytes forever (wrapping at 2**32); the ring index is
+// the count mod SERIAL_TX_RING_SIZE.
+// The writers (tasks, or even ISRs) change head, and the DMA interrupt
+// changes tail and in_flight; they share the ring under a short critical
+// section (interrupts off), since several tasks may write the same UART.
+#define SERIAL_TX_RING_SIZE 1024	// Bytes per UART; a power of two.
+
+struct serial_tx {
+    DMA_Channel_TypeDef *dma;
+    uint32_t dma_tcif, dma_cgif;	// This channel's bits in DMA1 ISR/IFCR.
+    uint32_t head, tail;		// Bytes queued; bytes sent.
+    uint32_t in_flight;			// Bytes in the current DMA transfer;
+					// 0 means the transmitter is idle.
+    uint32_t n_dropped;			// Bytes refused for lack of room.
+    void (*done) (void *arg);
+    void *done_arg;
+    bool enabled;
+    uint8_t buf[SERIAL_TX_RING_SIZE];
+};
+static struct serial_tx g_tx1 = { .dma_tcif=DMA_ISR_TCIF4,
+				  .dma_cgif=DMA_IFCR_CGIF4 },
+			g_tx2 = { .dma_tcif=DMA_ISR_TCIF7,
+				  .dma_cgif=DMA_IFCR_CGIF7 };
+
+static struct serial_tx *serial_tx_for (USART_TypeDef *USARTx) {
+    if (USARTx == USART1)
+	return (&g_tx1);
+    if (USARTx == USART2)
+	return (&g_tx2);
+    error ("Illegal UART");
+    return (0);
+}
+
+// Start a DMA transfer of the next contiguous run of queued bytes, if there
+// are any. Call with the transmitter idle and interrupts off (or from the
+// DMA interrupt itself).
+static void serial_tx_kick (struct serial_tx *tx) {
+    uint32_t queued = tx->head - tx->tail;
+    uint32_t offset = tx->tail & (SERIAL_TX_RING_SIZE-1);
+    uint32_t n = SERIAL_TX_RING_SIZE - offset;
+    if (n > queued)
+	n = queued;
+    tx->in_flight = n;
+    if (n == 0)
+	return;
+    tx->dma->CCR &= ~DMA_CCR_EN;	// CMAR and CNDTR only change when off.
+    tx->dma->CMAR = (uint32_t) &tx->buf[offset];
+    tx->dma->CNDTR = n;
+    tx->dma->CCR |= DMA_CCR_EN;
+}
+
+// Copy data[n] into the ring and start the DMA if it's idle. All or nothing:
+// returns false (and queues nothing) if there isn't room for all n bytes, so
+// that a frame never goes out half-written; then, if 'count_drop', the bytes
+// go in n_dropped, under the same critical section.
+static bool serial_tx_enqueue (struct serial_tx *tx, const uint8_t *data,
+			       uint32_t n, bool count_drop) {
+    uint32_t primask = __get_PRIMASK ();
+    __disable_irq ();
+    bool fits = (SERIAL_TX_RING_SIZE - (tx->head - tx->tail) >= n);
+    if (fits) {
+	for (uint32_t i=0; i<n; ++i)
+	    tx->buf[(tx->head + i) & (SERIAL_TX_RING_SIZE-1)] = data[i];
+	tx->head += n;
+	if (tx->in_flight == 0)
+	    serial_tx_kick (tx);
+    } else if (count_drop)
+	tx->n_dropped += n;
+    __set_PRIMASK (primask);
+    return (fits);
+}
+
+static void serial_tx_isr (struct serial_tx *tx) {
+    if ((DMA1->ISR & tx->dma_tcif) == 0)
+	return;
+    DMA1->IFCR = tx->dma_cgif;
+    tx->tail += tx->in_flight;
+    serial_tx_kick (tx);
+    if ((tx->in_flight == 0) && tx->done)
+	tx->done (tx->done_arg);
+}
+
+// USART1_TX is DMA1 channel 4, and USART2_TX is channel 7, both request 2.
+void DMA1_Channel4_IRQHandler (void) { serial_tx_isr (&g_tx1); }
+void DMA1_Channel7_IRQHandler (void) { serial_tx_isr (&g_tx2); }
+
+// Set up USARTx at 'baud' for non-blocking writes. 'priority' is the NVIC
+// priority of its DMA interrupt; if the done callback calls FreeRTOS
+// ...FromISR() functions, it must be numerically at or above
+// configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY.
+void serial_begin_nb (USART_TypeDef *USARTx, int baud, uint32_t priority) {
+    serial_begin_baud (USARTx, baud);
+    struct serial_tx *tx = serial_tx_for (USARTx);
+    IRQn_Type irq;
+    uint32_t csel_pos;
+    if (USARTx == USART1) {
+	tx->dma = DMA1_Channel4;  irq = DMA1_Channel4_IRQn;
+	csel_pos = DMA_CSELR_C4S_Pos;
+    } else {
+	tx->dma = DMA1_Channel7;  irq = DMA1_Channel7_IRQn;
+	csel_pos = DMA_CSELR_C7S_Pos;
+    }
+
+    // DMA: memory to peripheral (DIR=1), a byte at a time, memory-increment,
+    // interrupt on transfer-complete. Not circular: each transfer is set up
+    // by serial_tx_kick().
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+    tx->dma->CCR &= ~DMA_CCR_EN;
+    DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~(0xFU << csel_pos))
+		      | (2U << csel_pos);	// Request 0010 is USARTx_TX.
+    tx->dma->CPAR = (uint32_t) &USARTx->TDR;
+    tx->dma->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE;
+    DMA1->IFCR = tx->dma_cgif;
+    NVIC_SetPriority (irq, priority);
+    NVIC_EnableIRQ (irq);
+
+    // Have the UART ask the DMA for each byte (CR3.DMAT).
+    USARTx->ICR = USART_ICR_TCCF;
+    USARTx->CR3 |= USART_CR3_DMAT;
+    tx->head = tx->tail = tx->in_flight = 0;
+    tx->enabled = true;
+}
+
+bool serial_write_nb (USART_TypeDef *USARTx, const void *data, uint32_t n) {
+    struct serial_tx *tx = serial_tx_for (USARTx);
+    if (!tx->enabled)
+	error ("serial_write_nb() without serial_begin_nb()");
+    return (serial_tx_enqueue (tx, (const uint8_t *) data, n, true));
+}
+
+void serial_on_tx_done (USART_TypeDef *USARTx, void (*done) (void *arg),
+			void *arg) {
+    struct serial_tx *tx = serial_tx_for (USARTx);
+    uint32_t primask = __get_PRIMASK ();
+    __disable_irq ();
+    tx->done = done;
+    tx->done_arg = arg;
+    __set_PRIMASK (primask);
+}
+
+bool serial_tx_busy (USART_TypeDef *USARTx) {
+    return (*(volatile uint32_t *) &serial_tx_for (USARTx)->in_flight != 0);
+}
+
+uint32_t serial_tx_free (USART_TypeDef *USARTx) {
+    struct serial_tx *tx = serial_tx_for (USARTx);
+    return (SERIAL_TX_RING_SIZE - (*(volatile uint32_t *)&tx->head
+				   - *(volatile uint32_t *)&tx->tail));
+}
+
+uint32_t serial_tx_dropped (USART_TypeDef *USARTx) {
+    return (serial_tx_for (USARTx)->n_dropped);
+}
+
+// serial_write() on a UART that's set up for DMA: its bytes have to go
+// through the same ring, or they'd collide with the DMA's. So queue them,
+// waiting for room as need be, and then wait until they've all gone out.
+// Returns false (having done nothing) if the UART isn't set up for DMA.
+static bool serial_write_queued (USART_TypeDef *USARTx, const char *buffer) {
+    struct serial_tx *tx = (USARTx == USART1) ? &g_tx1
+			 : (USARTx == USART2) ? &g_tx2 : 0;
+    if ((tx == 0) || !tx->enabled)
+	return (false);
+    for (const char *p=buffer; *p; ++p)
+	while (!serial_tx_enqueue (tx, (const uint8_t *) p, 1, false))
+	    ;
+    while (serial_tx_busy (USARTx))
+	;
+    return (true);
+}
+
 char serial_read (USART_TypeDef *USARTx) {
     // The SR_RXNE (Read data register not empty) bit is set by hardware.
     // We spin wait until that bit is set
@@ -233,3 +429,51 @@ char serial_read (USART_TypeDef *USARTx) {
     // Reading USART_DR automatically clears the RXNE flag 
     return ((char)(USARTx->RDR & 0xFF));
 }
+
+/////////////////////////////////////////////
+// Interrupt-driven receive.
+/////////////////////////////////////////////
+
+// Each byte that comes in is handed to the UART's callback, from its
+// interrupt. Only UARTs whose receiver is on take part: USART2 (the
+// ST-Link's virtual COM port), but not USART1, which only drives the LCD.
+struct serial_rx {
+    void (*rx) (void *arg, uint8_t byte);
+    void *arg;
+};
+static struct serial_rx g_rx1, g_rx2;
+
+static void serial_rx_isr (USART_TypeDef *USARTx, struct serial_rx *rx) {
+    uint32_t isr = USARTx->ISR;
+    // An overrun (a byte lost because we were too slow) also interrupts,
+    // and keeps on interrupting until it's cleared.
+    if (isr & USART_ISR_ORE)
+	USARTx->ICR = USART_ICR_ORECF;
+    if (isr & USART_ISR_RXNE) {
+	uint8_t byte = (uint8_t) USARTx->RDR;	// Clears RXNE.
+	if (rx->rx)
+	    rx->rx (rx->arg, byte);
+    }
+}
+
+void USART1_IRQHandler (void) { serial_rx_isr (USART1, &g_rx1); }
+void USART2_IRQHandler (void) { serial_rx_isr (USART2, &g_rx2); }
+
+void serial_on_rx (USART_TypeDef *USARTx, void (*rx) (void *arg, uint8_t byte),
+		   void *arg, uint32_t priority) {
+    struct serial_rx *r;
+    IRQn_Type irq;
+    if (USARTx == USART1) {
+	r = &g_rx1;  irq = USART1_IRQn;
+    } else if (USARTx == USART2) {
+	r = &g_rx2;  irq = USART2_IRQn;
+    } else
+	error ("Illegal UART");
+    NVIC_DisableIRQ (irq);
+    r->rx = rx;
+    r->arg = arg;
+    USARTx->ICR = USART_ICR_ORECF;
+    USARTx->CR1 |= USART_CR1_RXNEIE;
+    NVIC_SetPriority (irq, priority);
+    NVIC_EnableIRQ (irq);
+}
@@ -197,6 +197,46 @@ void clock_setup_80MHz(void){
 #endif
 }
 
+////////////////////////////////////////////////////////////////////
+// Basic timers (TIM6 and TIM7) as hardware sample clocks.
+////////////////////////////////////////////////////////////////////
+
+// Set 'tim' (TIM6 or TIM7) to overflow at exactly rate_hz and send each
+// update event out as TRGO (CR2.MMS=010), which the ADC and DAC can use as a
+// conversion trigger. The timer is left stopped; set TIM_CR1_CEN once
+// whatever it triggers is ready. Both timers are on APB1, which runs at HCLK
+// (see clock_setup_80MHz()). We count at 1 MHz, so the period is a whole
+// number of us; the counter is 16 bits, so that allows 16 Hz to 1 MHz.
+void basic_timer_init (TIM_TypeDef *tim, uint32_t rate_hz) {
+    uint32_t period_us = (rate_hz > 0) ? 1000000 / rate_hz : 0;
+    if ((period_us == 0) || (period_us > 65536))
+	error ("Bad timer rate");
+    if (tim == TIM6)
+	RCC->APB1ENR1 |= RCC_APB1ENR1_TIM6EN;
+    else if (tim == TIM7)
+	RCC->APB1ENR1 |= RCC_APB1ENR1_TIM7EN;
+    else
+	error ("basic_timer_init() only handles TIM6 and TIM7");
+
+    tim->CR1 &= ~TIM_CR1_CEN;
+    tim->PSC = SystemCoreClock / 1000000 - 1;
+    tim->ARR = period_us - 1;
+    tim->CR2 = (tim->CR2 & ~TIM_CR2_MMS) | TIM_CR2_MMS_1;
+    tim->EGR = TIM_EGR_UG;	// Load PSC now, rather than at the first update.
+}
+
+////////////////////////////////////////////////////////////////////
+// The DWT cycle counter, for timing things to the cycle.
+////////////////////////////////////////////////////////////////////
+
+// The DWT is part of the debug unit, so it has to be let in by TRCENA
+// first; it's there whether or not a debugger is attached.
+void cycle_counter_start (void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
 ////////////////////////////////////////////////////////////////////
 // Spin-loop delay, from the Arduino API.
 ////////////////////////////////////////////////////////////////////
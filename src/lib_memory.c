@@ -0,0 +1,113 @@
+//****************************************************
+// Memory report. See lib_memory.h.
+//****************************************************
+
+#include <string.h>
+#include "lib_memory.h"
+
+bool ptc_mem_add_task (struct ptc_mem_report *r, uint32_t number,
+		       const char *name, uint32_t stack_words,
+		       uint32_t stack_min_free_words) {
+    if (r->n_tasks >= PTC_MEM_MAX_TASKS)
+	return (false);
+    struct ptc_mem_task *t = &r->tasks[r->n_tasks++];
+    t->number = number;
+    memset (t->name, 0, sizeof t->name);
+    strncpy (t->name, name, PTC_MEM_NAME_LEN);
+    t->stack_words = stack_words;
+    t->stack_min_free_words = stack_min_free_words;
+    return (true);
+}
+
+bool ptc_mem_add_pool (struct ptc_mem_report *r, const struct ptc_pool *p) {
+    if (r->n_pools >= PTC_MEM_MAX_POOLS)
+	return (false);
+    struct ptc_mem_pool *m = &r->pools[r->n_pools++];
+    m->block_size = p->block_size;
+    m->n_blocks = p->n_blocks;
+    m->n_free = p->n_free;
+    m->min_free = p->min_free;
+    m->n_allocs = p->n_allocs;
+    m->n_failed = p->n_failed;
+    return (true);
+}
+
+uint32_t ptc_mem_to_words (const struct ptc_mem_report *r, uint32_t *words) {
+    const struct ptc_mem_heap *h = &r->heap;
+    uint32_t w = 0;
+    words[w++] = r->n_tasks;
+    words[w++] = r->have_heap;
+    words[w++] = h->total;
+    words[w++] = h->free;
+    words[w++] = h->min_free;
+    words[w++] = h->largest_free;
+    words[w++] = h->smallest_free;
+    words[w++] = h->n_free_blocks;
+    words[w++] = h->n_allocs;
+    words[w++] = h->n_frees;
+    words[w++] = r->n_pools;
+    for (uint32_t i=0; i<r->n_pools; ++i) {
+	const struct ptc_mem_pool *m = &r->pools[i];
+	words[w++] = m->block_size;
+	words[w++] = m->n_blocks;
+	words[w++] = m->n_free;
+	words[w++] = m->min_free;
+	words[w++] = m->n_allocs;
+	words[w++] = m->n_failed;
+    }
+    for (uint32_t i=0; i<r->n_tasks; ++i) {
+	const struct ptc_mem_task *t = &r->tasks[i];
+	words[w++] = t->number;
+	words[w++] = t->stack_words;
+	words[w++] = t->stack_min_free_words;
+	for (int n=0; n<PTC_MEM_NAME_LEN/4; ++n, ++w) {
+	    words[w] = 0;
+	    for (int b=0; b<4; ++b)
+		words[w] |= (uint32_t) (uint8_t) t->name[4*n+b] << (8*b);
+	}
+    }
+    return (w);
+}
+
+bool ptc_mem_from_words (const uint32_t *words, uint32_t n_words,
+			 struct ptc_mem_report *r) {
+    const uint32_t n_head = 3 + PTC_MEM_HEAP_WORDS;
+    if ((n_words < n_head) || (words[0] > PTC_MEM_MAX_TASKS)
+	|| (words[n_head-1] > PTC_MEM_MAX_POOLS)
+	|| (n_words != n_head + PTC_MEM_POOL_WORDS*words[n_head-1]
+		       + PTC_MEM_TASK_WORDS*words[0]))
+	return (false);
+    struct ptc_mem_heap *h = &r->heap;
+    uint32_t w = 0;
+    r->n_tasks = words[w++];
+    r->have_heap = (words[w++] != 0);
+    h->total = words[w++];
+    h->free = words[w++];
+    h->min_free = words[w++];
+    h->largest_free = words[w++];
+    h->smallest_free = words[w++];
+    h->n_free_blocks = words[w++];
+    h->n_allocs = words[w++];
+    h->n_frees = words[w++];
+    r->n_pools = words[w++];
+    for (uint32_t i=0; i<r->n_pools; ++i) {
+	struct ptc_mem_pool *m = &r->pools[i];
+	m->block_size = words[w++];
+	m->n_blocks = words[w++];
+	m->n_free = words[w++];
+	m->min_free = words[w++];
+	m->n_allocs = words[w++];
+	m->n_failed = words[w++];
+    }
+    for (uint32_t i=0; i<r->n_tasks; ++i) {
+	struct ptc_mem_task *t = &r->tasks[i];
+	t->number = words[w++];
+	t->stack_words = words[w++];
+	t->stack_min_free_words = words[w++];
+	for (int c=0; c<PTC_MEM_NAME_LEN; ++c)
+	    t->name[c] = (char) (words[w + c/4] >> (8 * (c%4)));
+	t->name[PTC_MEM_NAME_LEN] = '\0';
+	w += PTC_MEM_NAME_LEN/4;
+    }
+    return (true);
+}
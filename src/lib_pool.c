@@ -0,0 +1,68 @@
+//****************************************************
+// Fixed-block pool. See lib_pool.h.
+//****************************************************
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lib_pool.h"
+
+// As in lib_trace.c: PRIMASK nests, so this works from tasks, from ISRs and
+// from inside critical sections alike.
+#if defined(__arm__)
+#include "stm32l432xx.h"
+#define POOL_LOCK(p)	uint32_t primask = __get_PRIMASK (); __disable_irq ()
+#define POOL_UNLOCK(p)	__set_PRIMASK (primask)
+#else
+#define POOL_LOCK(p)	while (__atomic_test_and_set (&(p)->lock, __ATOMIC_ACQUIRE))
+#define POOL_UNLOCK(p)	__atomic_clear (&(p)->lock, __ATOMIC_RELEASE)
+#endif
+
+bool ptc_pool_init (struct ptc_pool *p, void **storage,
+		    uint32_t block_size, uint32_t n_blocks) {
+    if ((n_blocks == 0) || (block_size == 0))
+	return (false);
+    p->blocks = (uint8_t *) storage;
+    p->block_size = PTC_POOL_BLOCK_PTRS (block_size) * sizeof (void *);
+    p->n_blocks = n_blocks;
+    p->lock = 0;
+    // Thread the free list through the blocks, first block first.
+    p->free_list = NULL;
+    for (uint32_t b=n_blocks; b-- > 0; ) {
+	void **block = (void **) (p->blocks + b * p->block_size);
+	*block = p->free_list;
+	p->free_list = block;
+    }
+    p->n_free = p->min_free = n_blocks;
+    p->n_allocs = p->n_frees = p->n_failed = 0;
+    return (true);
+}
+
+void *ptc_pool_alloc (struct ptc_pool *p) {
+    POOL_LOCK (p);
+    void **block = (void **) p->free_list;
+    if (block == NULL)
+	++p->n_failed;
+    else {
+	p->free_list = *block;
+	++p->n_allocs;
+	if (--p->n_free < p->min_free)
+	    p->min_free = p->n_free;
+    }
+    POOL_UNLOCK (p);
+    return (block);
+}
+
+bool ptc_pool_free (struct ptc_pool *p, void *block) {
+    // In range first, so that a pointer from far away can't wrap into it.
+    uintptr_t start = (uintptr_t) p->blocks, at = (uintptr_t) block;
+    if ((at < start) || (at >= start + (uintptr_t) p->n_blocks * p->block_size)
+	|| ((at - start) % p->block_size != 0))
+	return (false);
+    POOL_LOCK (p);
+    *(void **) block = p->free_list;
+    p->free_list = block;
+    ++p->n_free;
+    ++p->n_frees;
+    POOL_UNLOCK (p);
+    return (true);
+}
@@ -0,0 +1,97 @@
+//****************************************************
+// Per-stage profiler. See lib_profile.h.
+//****************************************************
+
+#include <string.h>
+#include <time.h>
+#include "lib_profile.h"
+
+struct ptc_prof_stats ptc_prof[PTC_PROF_N_STAGES];
+uint8_t ptc_prof_levels = PTC_PROF_ALL_LEVELS;
+
+static const char *const stage_names[PTC_PROF_N_STAGES] = {
+    "acquire", "lowpass", "peak_1", "thresh_1", "deriv_2", "window_2",
+    "peak_2", "thresh_2", "pipeline", "output", "block" };
+
+void ptc_prof_record (int stage, uint32_t counts, uint32_t n_samples) {
+    struct ptc_prof_stats *s = &ptc_prof[stage];
+    if ((s->n == 0) || (counts < s->min))
+	s->min = counts;
+    if (counts > s->max)
+	s->max = counts;
+    ++s->n;
+    s->n_samples += n_samples;
+    s->sum += counts;
+    int b = (counts == 0) ? 0 : 32 - __builtin_clz (counts);
+    ++s->hist[(b < PTC_PROF_N_BUCKETS) ? b : PTC_PROF_N_BUCKETS-1];
+}
+
+void ptc_prof_next_level (void) {
+    ptc_prof_levels = (ptc_prof_levels == 1 || ptc_prof_levels == 2)
+		    ? ptc_prof_levels << 1 : 1;
+}
+
+void ptc_prof_reset (void) {
+    memset (ptc_prof, 0, sizeof ptc_prof);
+}
+
+uint32_t ptc_prof_counts_per_us (void) {
+#if defined(__arm__)
+    extern uint32_t SystemCoreClock;
+    return (SystemCoreClock / 1000000);
+#elif defined(__x86_64__) || defined(__i386__)
+    // Time the TSC against the monotonic clock.
+    static uint32_t counts_per_us = 0;
+    if (counts_per_us == 0) {
+	struct timespec t0, t1;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	uint64_t c0 = __rdtsc ();
+	uint64_t ns;
+	do {
+	    clock_gettime (CLOCK_MONOTONIC, &t1);
+	    ns = (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec
+	       - t0.tv_nsec;
+	} while (ns < 20000000);
+	counts_per_us = (uint32_t) ((__rdtsc () - c0) * 1000 / ns);
+	if (counts_per_us == 0)
+	    counts_per_us = 1;
+    }
+    return (counts_per_us);
+#else
+    return (1000);
+#endif
+}
+
+const char *ptc_prof_stage_name (int stage) {
+    return (((stage >= 0) && (stage < PTC_PROF_N_STAGES))
+	    ? stage_names[stage] : "?");
+}
+
+void ptc_prof_to_words (int stage, uint32_t *words) {
+    const struct ptc_prof_stats *s = &ptc_prof[stage];
+    words[0] = (uint32_t) stage;
+    words[1] = ptc_prof_counts_per_us ();
+    words[2] = s->n;
+    words[3] = s->n_samples;
+    words[4] = s->min;
+    words[5] = s->max;
+    words[6] = (uint32_t) s->sum;
+    words[7] = (uint32_t) (s->sum >> 32);
+    for (int b=0; b<PTC_PROF_N_BUCKETS; ++b)
+	words[8+b] = s->hist[b];
+}
+
+int ptc_prof_from_words (const uint32_t *words, uint32_t *counts_per_us,
+			 struct ptc_prof_stats *stats) {
+    if (words[0] >= PTC_PROF_N_STAGES)
+	return (-1);
+    *counts_per_us = words[1];
+    stats->n = words[2];
+    stats->n_samples = words[3];
+    stats->min = words[4];
+    stats->max = words[5];
+    stats->sum = words[6] | ((uint64_t) words[7] << 32);
+    for (int b=0; b<PTC_PROF_N_BUCKETS; ++b)
+	stats->hist[b] = words[8+b];
+    return ((int) words[0]);
+}
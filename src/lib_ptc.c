@@ -0,0 +1,284 @@
+//****************************************************
+// PTC signal-processing kernels. See lib_ptc.h.
+//****************************************************
+
+#include "lib_ptc.h"
+
+//****************************************************
+// Biquad filtering.
+//****************************************************
+
+const struct biquadcoeffs biquad_20Hz_lowpass[N_BIQUAD_SECS] =
+	BIQUAD_20HZ_LOWPASS_COEFFS;
+
+// Biquad filtering routine.
+// - The input is assumed to be a 12-bit unsigned integer coming straight from
+//   the ADC. We convert it immediately to a float xn in the range [0,1).
+// - Compute yn = b0*xn + b1*x_nm1 + b2*x_nm2 - a1*y_nm1 - a2*y_nm2
+// - Update x_nm1->x_nm2, xn->x_nm1, y_nm1->y_nm2, yn->y_nm1
+// - Return yn as a 12-bit integer.
+int biquad (const struct biquadcoeffs *coeffs, struct biquadstate *state,
+	    uint32_t sample, uint32_t n_bits) {
+    float xn = ((float)sample) / ((float)(1<<n_bits)); // current sample
+    float yn = coeffs->b0*xn + coeffs->b1*state->x_nm1 + coeffs->b2*state->x_nm2
+	     - coeffs->a1*state->y_nm1 - coeffs->a2*state->y_nm2; // output
+
+    state->x_nm2 = state->x_nm1;
+    state->x_nm1 = xn;
+    state->y_nm2 = state->y_nm1;
+    state->y_nm1 = yn;
+
+    return (yn * (1<<n_bits));
+}
+
+// We filter a long block in pieces of this many samples, so that the float
+// scratch buffer can live on the (small) FreeRTOS task stack.
+#define BIQUAD_CHUNK 32
+
+// Block version of the cascade.
+// We go section-major over each chunk: load one section's state into locals,
+// run the whole chunk through it, store the state back, and move on to the
+// next section. That keeps the recursion in registers, and pays for exactly
+// one int->float conversion per sample on input and one on output.
+// Scaling by 2**n_bits is done with a multiply by its reciprocal, which is
+// exact for a power of two, so the first section sees exactly the same xn as
+// biquad() would.
+void biquad_cascade (const struct biquadcoeffs *coeffs,
+		     struct biquadstate *state, int n_secs,
+		     const int *in, int *out, int n, uint32_t n_bits) {
+    const float scale = (float)(1<<n_bits);
+    const float inv_scale = 1.0f / scale;
+    float buf[BIQUAD_CHUNK];
+
+    for (int base=0; base<n; base+=BIQUAD_CHUNK) {
+	int len = n - base;
+	if (len > BIQUAD_CHUNK) len = BIQUAD_CHUNK;
+
+	for (int i=0; i<len; ++i)
+	    buf[i] = ((float)in[base+i]) * inv_scale;
+
+	for (int s=0; s<n_secs; ++s) {
+	    const float b0=coeffs[s].b0, b1=coeffs[s].b1, b2=coeffs[s].b2;
+	    const float a1=coeffs[s].a1, a2=coeffs[s].a2;
+	    float x_nm1=state[s].x_nm1, x_nm2=state[s].x_nm2;
+	    float y_nm1=state[s].y_nm1, y_nm2=state[s].y_nm2;
+
+	    for (int i=0; i<len; ++i) {
+		float xn = buf[i];
+		float yn = b0*xn + b1*x_nm1 + b2*x_nm2 - a1*y_nm1 - a2*y_nm2;
+		x_nm2 = x_nm1;  x_nm1 = xn;
+		y_nm2 = y_nm1;  y_nm1 = yn;
+		buf[i] = yn;
+	    }
+
+	    state[s].x_nm1=x_nm1;  state[s].x_nm2=x_nm2;
+	    state[s].y_nm1=y_nm1;  state[s].y_nm2=y_nm2;
+	}
+
+	for (int i=0; i<len; ++i)
+	    out[base+i] = (int)(buf[i] * scale);
+    }
+}
+
+//****************************************************
+// Fixed-point biquads.
+//****************************************************
+
+// On the M4, use the ACLE DSP intrinsics (GCC has them from version 10 on).
+// Everywhere else, plain C computes exactly the same thing.
+#if defined(__ARM_FEATURE_SIMD32) && defined(__ARM_FEATURE_SAT) \
+    && (__GNUC__ >= 10)
+#define PTC_USE_ACLE_DSP
+#include <arm_acle.h>
+#endif
+
+// Clamp a 64-bit accumulator into a Q31 or Q15 sample.
+static inline int32_t sat_q31 (int64_t x) {
+    if (x > INT32_MAX) return (INT32_MAX);
+    if (x < INT32_MIN) return (INT32_MIN);
+    return ((int32_t) x);
+}
+static inline int16_t sat_q15 (int64_t x) {
+#ifdef PTC_USE_ACLE_DSP
+    // One SSAT instruction, once we know that x fits in 32 bits.
+    return ((int16_t) __ssat (sat_q31 (x), 16));
+#else
+    if (x > INT16_MAX) return (INT16_MAX);
+    if (x < INT16_MIN) return (INT16_MIN);
+    return ((int16_t) x);
+#endif
+}
+
+// The guts of both quantizers. Rebalance the section gains, pick the smallest
+// post_shift such that every coefficient is < 2**post_shift, and then write
+// each section's b0,b1,b2,-a1,-a2 as 'frac_bits'-bit fractions (scaled down
+// by 2**post_shift) to out[5*sec + 0..4]. The math is in double, since this
+// only runs once at startup.
+#define BIQUAD_MAX_POST_SHIFT 8
+static int biquad_quantize (const struct biquadcoeffs *coeffs, int n_secs,
+			    int frac_bits, int32_t *out) {
+    double bal[n_secs][5];
+    double removed_gain = 1.0;	// DC gain taken out of earlier sections.
+    double biggest = 0.0;
+    for (int s=0; s<n_secs; ++s) {
+	const struct biquadcoeffs *c = &coeffs[s];
+	double a0 = (c->a0 == 0.0f) ? 1.0 : c->a0;
+	double b0=c->b0/a0, b1=c->b1/a0, b2=c->b2/a0;
+	double a1=c->a1/a0, a2=c->a2/a0;
+
+	// Each section but the last is normalized to unity DC gain (sections
+	// with no DC response, such as highpass or bandpass, are left alone);
+	// the last one gets all the gain we took out.
+	double dc = (b0+b1+b2) / (1.0+a1+a2);
+	if (s < n_secs-1) {
+	    if (dc != 0.0) {
+		b0 /= dc;  b1 /= dc;  b2 /= dc;
+		removed_gain *= dc;
+	    }
+	} else {
+	    b0 *= removed_gain;  b1 *= removed_gain;  b2 *= removed_gain;
+	}
+	bal[s][0]=b0;   bal[s][1]=b1;   bal[s][2]=b2;
+	bal[s][3]=-a1;  bal[s][4]=-a2;
+	for (int i=0; i<5; ++i) {
+	    double mag = bal[s][i] < 0 ? -bal[s][i] : bal[s][i];
+	    if (mag > biggest) biggest = mag;
+	}
+    }
+
+    int post_shift=0;
+    while ((1<<post_shift) <= biggest)
+	if (++post_shift > BIQUAD_MAX_POST_SHIFT)
+	    return (-1);
+
+    double one = (double)((int64_t)1 << (frac_bits-post_shift));
+    int64_t max = ((int64_t)1 << frac_bits) - 1, min = -max-1;
+    for (int s=0; s<n_secs; ++s)
+	for (int i=0; i<5; ++i) {
+	    double scaled = bal[s][i] * one;
+	    int64_t q = (int64_t)(scaled < 0 ? scaled-0.5 : scaled+0.5);
+	    out[5*s+i] = (int32_t)(q > max ? max : (q < min ? min : q));
+	}
+    return (post_shift);
+}
+
+int biquad_quantize_q31 (const struct biquadcoeffs *coeffs, int n_secs,
+			 struct biquad_q31_coeffs *out) {
+    int32_t q[5*n_secs];
+    int post_shift = biquad_quantize (coeffs, n_secs, 31, q);
+    for (int s=0; s<n_secs; ++s) {
+	out[s].b0=q[5*s];   out[s].b1=q[5*s+1]; out[s].b2=q[5*s+2];
+	out[s].a1=q[5*s+3]; out[s].a2=q[5*s+4];
+    }
+    return (post_shift);
+}
+
+int biquad_quantize_q15 (const struct biquadcoeffs *coeffs, int n_secs,
+			 struct biquad_q15_coeffs *out) {
+    int32_t q[5*n_secs];
+    int post_shift = biquad_quantize (coeffs, n_secs, 15, q);
+    for (int s=0; s<n_secs; ++s) {
+	out[s].b0=q[5*s];   out[s].b1=q[5*s+1]; out[s].b2=q[5*s+2];
+	out[s].a1=q[5*s+3]; out[s].a2=q[5*s+4];
+    }
+    return (post_shift);
+}
+
+// Q31 cascade.
+// We use out[] itself as the Q31 scratch buffer: convert the whole block in,
+// run it through each section in place (section-major, with the section
+// state in locals), and convert it back out. Each product is a 32x32->64-bit
+// multiply-accumulate, which the M4 does in one SMLAL.
+void biquad_cascade_q31 (const struct biquad_q31_coeffs *coeffs,
+			 struct biquad_q31_state *state, int n_secs,
+			 int post_shift, const int *in, int *out, int n,
+			 uint32_t n_bits) {
+    const int in_shift = 31 - BIQUAD_Q_HEADROOM - n_bits;
+    const int acc_shift = 31 - post_shift;
+    const int64_t acc_round = (int64_t)1 << (acc_shift-1);
+
+    for (int i=0; i<n; ++i)
+	out[i] = sat_q31 ((int64_t)in[i] * ((int64_t)1<<in_shift));
+
+    for (int s=0; s<n_secs; ++s) {
+	const int32_t b0=coeffs[s].b0, b1=coeffs[s].b1, b2=coeffs[s].b2;
+	const int32_t a1=coeffs[s].a1, a2=coeffs[s].a2;
+	int32_t x_nm1=state[s].x_nm1, x_nm2=state[s].x_nm2;
+	int32_t y_nm1=state[s].y_nm1, y_nm2=state[s].y_nm2;
+
+	for (int i=0; i<n; ++i) {
+	    int32_t xn = out[i];
+	    int64_t acc = acc_round;
+	    acc += (int64_t)b0*xn    + (int64_t)b1*x_nm1 + (int64_t)b2*x_nm2;
+	    acc += (int64_t)a1*y_nm1 + (int64_t)a2*y_nm2;
+	    int32_t yn = sat_q31 (acc >> acc_shift);
+	    x_nm2 = x_nm1;  x_nm1 = xn;
+	    y_nm2 = y_nm1;  y_nm1 = yn;
+	    out[i] = yn;
+	}
+
+	state[s].x_nm1=x_nm1;  state[s].x_nm2=x_nm2;
+	state[s].y_nm1=y_nm1;  state[s].y_nm2=y_nm2;
+    }
+
+    const int32_t out_round = (int32_t)1 << (in_shift-1);
+    for (int i=0; i<n; ++i)
+	out[i] = (int)(((int64_t)out[i] + out_round) >> in_shift);
+}
+
+#ifdef PTC_USE_ACLE_DSP
+// Pack two Q15 values into one word, 'lo' in the bottom halfword. GCC turns
+// this into a single PKHBT.
+static inline int16x2_t pack_q15 (int32_t lo, int32_t hi) {
+    return ((int16x2_t)((uint32_t)(uint16_t)lo | ((uint32_t)hi << 16)));
+}
+#endif
+
+// Q15 cascade. Same structure as the Q31 one. On the M4, the five products
+// are two dual 16x16 multiply-accumulates into 64 bits (SMLALD) plus one
+// single one.
+void biquad_cascade_q15 (const struct biquad_q15_coeffs *coeffs,
+			 struct biquad_q15_state *state, int n_secs,
+			 int post_shift, const int *in, int *out, int n,
+			 uint32_t n_bits) {
+    const int in_shift = 15 - BIQUAD_Q_HEADROOM - n_bits;
+    const int acc_shift = 15 - post_shift;
+    const int64_t acc_round = (int64_t)1 << (acc_shift-1);
+
+    for (int i=0; i<n; ++i)
+	out[i] = sat_q15 ((int64_t)in[i] * (1<<in_shift));
+
+    for (int s=0; s<n_secs; ++s) {
+	const int32_t b0=coeffs[s].b0, b1=coeffs[s].b1, b2=coeffs[s].b2;
+	const int32_t a1=coeffs[s].a1, a2=coeffs[s].a2;
+	int32_t x_nm1=state[s].x_nm1, x_nm2=state[s].x_nm2;
+	int32_t y_nm1=state[s].y_nm1, y_nm2=state[s].y_nm2;
+#ifdef PTC_USE_ACLE_DSP
+	const int16x2_t b0b1 = pack_q15 (b0, b1), b2a1 = pack_q15 (b2, a1);
+#endif
+
+	for (int i=0; i<n; ++i) {
+	    int32_t xn = out[i];
+	    int64_t acc = acc_round;
+#ifdef PTC_USE_ACLE_DSP
+	    acc = __smlald (b0b1, pack_q15 (xn, x_nm1), acc);
+	    acc = __smlald (b2a1, pack_q15 (x_nm2, y_nm1), acc);
+	    acc += a2*y_nm2;
+#else
+	    acc += (int64_t)b0*xn    + (int64_t)b1*x_nm1 + (int64_t)b2*x_nm2;
+	    acc += (int64_t)a1*y_nm1 + (int64_t)a2*y_nm2;
+#endif
+	    int32_t yn = sat_q15 (acc >> acc_shift);
+	    x_nm2 = x_nm1;  x_nm1 = xn;
+	    y_nm2 = y_nm1;  y_nm1 = yn;
+	    out[i] = yn;
+	}
+
+	state[s].x_nm1=x_nm1;  state[s].x_nm2=x_nm2;
+	state[s].y_nm1=y_nm1;  state[s].y_nm2=y_nm2;
+    }
+
+    const int32_t out_round = (int32_t)1 << (in_shift-1);
+    for (int i=0; i<n; ++i)
+	out[i] = (out[i] + out_round) >> in_shift;
+}
@@ -0,0 +1,227 @@
+//****************************************************
+// The multi-channel PTC pipeline. See lib_ptc.h.
+// Each stage is a loop over channels on struct-of-arrays state. The integer
+// stages are written without branches (selects instead of ifs) so that the
+// compiler can vectorize them; the float biquads, which are the most work,
+// are written with SSE/AVX2 intrinsics on the host. On the board everything
+// is plain scalar C.
+//****************************************************
+
+#include <string.h>
+#include "lib_ptc.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PTC_LANES 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PTC_LANES 4
+#else
+#define PTC_LANES 1
+#endif
+
+// The moving-threshold parameters; see Threshold in ptc_pipeline.hpp.
+#define THRESH_INIT	0x7FF
+#define THRESH1_MIN	0xFFF
+#define THRESH1_DECAY	15
+#define THRESH2_MIN	0x2FF
+#define THRESH2_DECAY	4
+
+int ptc_multi_init (struct ptc_multi *p, int n_ch) {
+    if ((n_ch < 1) || (n_ch > PTC_MAX_CHANNELS))
+	return (-1);
+    memset (p, 0, sizeof *p);
+    p->n_ch = n_ch;
+    p->n_lanes = (n_ch + PTC_LANES-1) / PTC_LANES * PTC_LANES;
+    for (int c=0; c<PTC_MAX_CHANNELS; ++c) {
+	p->thresh1[c] = p->thresh2[c] = THRESH_INIT;
+	p->thresh1_max[c] = p->thresh2_max[c] = 0x000;
+	p->thresh1_min[c] = THRESH1_MIN;
+	p->thresh2_min[c] = THRESH2_MIN;
+    }
+    return (0);
+}
+
+//****************************************************
+// The stages. Each one works on all lanes at once.
+//****************************************************
+
+// Run the 20Hz lowpass on every lane; in[] and out[] are 12-bit integers.
+// The arithmetic is exactly that of biquad_cascade(), in the same order.
+static void multi_lowpass (struct ptc_multi *p, const int *in, int *out) {
+    const float scale = (float)(1<<12), inv_scale = 1.0f/scale;
+    const struct biquadcoeffs *co = biquad_20Hz_lowpass;
+
+#if PTC_LANES == 8
+    for (int c=0; c<p->n_lanes; c+=8) {
+	__m256 x = _mm256_mul_ps (_mm256_cvtepi32_ps (
+			_mm256_loadu_si256 ((const __m256i *)&in[c])),
+			_mm256_set1_ps (inv_scale));
+	for (int s=0; s<N_BIQUAD_SECS; ++s) {
+	    __m256 x1 = _mm256_loadu_ps (&p->bq_x_nm1[s][c]);
+	    __m256 x2 = _mm256_loadu_ps (&p->bq_x_nm2[s][c]);
+	    __m256 y1 = _mm256_loadu_ps (&p->bq_y_nm1[s][c]);
+	    __m256 y2 = _mm256_loadu_ps (&p->bq_y_nm2[s][c]);
+	    __m256 y = _mm256_mul_ps (_mm256_set1_ps (co[s].b0), x);
+	    y = _mm256_add_ps (y, _mm256_mul_ps (_mm256_set1_ps(co[s].b1), x1));
+	    y = _mm256_add_ps (y, _mm256_mul_ps (_mm256_set1_ps(co[s].b2), x2));
+	    y = _mm256_sub_ps (y, _mm256_mul_ps (_mm256_set1_ps(co[s].a1), y1));
+	    y = _mm256_sub_ps (y, _mm256_mul_ps (_mm256_set1_ps(co[s].a2), y2));
+	    _mm256_storeu_ps (&p->bq_x_nm2[s][c], x1);
+	    _mm256_storeu_ps (&p->bq_x_nm1[s][c], x);
+	    _mm256_storeu_ps (&p->bq_y_nm2[s][c], y1);
+	    _mm256_storeu_ps (&p->bq_y_nm1[s][c], y);
+	    x = y;
+	}
+	_mm256_storeu_si256 ((__m256i *)&out[c], _mm256_cvttps_epi32 (
+			_mm256_mul_ps (x, _mm256_set1_ps (scale))));
+    }
+#elif PTC_LANES == 4
+    for (int c=0; c<p->n_lanes; c+=4) {
+	__m128 x = _mm_mul_ps (_mm_cvtepi32_ps (
+			_mm_loadu_si128 ((const __m128i *)&in[c])),
+			_mm_set1_ps (inv_scale));
+	for (int s=0; s<N_BIQUAD_SECS; ++s) {
+	    __m128 x1 = _mm_loadu_ps (&p->bq_x_nm1[s][c]);
+	    __m128 x2 = _mm_loadu_ps (&p->bq_x_nm2[s][c]);
+	    __m128 y1 = _mm_loadu_ps (&p->bq_y_nm1[s][c]);
+	    __m128 y2 = _mm_loadu_ps (&p->bq_y_nm2[s][c]);
+	    __m128 y = _mm_mul_ps (_mm_set1_ps (co[s].b0), x);
+	    y = _mm_add_ps (y, _mm_mul_ps (_mm_set1_ps (co[s].b1), x1));
+	    y = _mm_add_ps (y, _mm_mul_ps (_mm_set1_ps (co[s].b2), x2));
+	    y = _mm_sub_ps (y, _mm_mul_ps (_mm_set1_ps (co[s].a1), y1));
+	    y = _mm_sub_ps (y, _mm_mul_ps (_mm_set1_ps (co[s].a2), y2));
+	    _mm_storeu_ps (&p->bq_x_nm2[s][c], x1);
+	    _mm_storeu_ps (&p->bq_x_nm1[s][c], x);
+	    _mm_storeu_ps (&p->bq_y_nm2[s][c], y1);
+	    _mm_storeu_ps (&p->bq_y_nm1[s][c], y);
+	    x = y;
+	}
+	_mm_storeu_si128 ((__m128i *)&out[c], _mm_cvttps_epi32 (
+			_mm_mul_ps (x, _mm_set1_ps (scale))));
+    }
+#else
+    for (int c=0; c<p->n_lanes; ++c) {
+	float x = ((float)in[c]) * inv_scale;
+	for (int s=0; s<N_BIQUAD_SECS; ++s) {
+	    float y = co[s].b0*x + co[s].b1*p->bq_x_nm1[s][c]
+		    + co[s].b2*p->bq_x_nm2[s][c]
+		    - co[s].a1*p->bq_y_nm1[s][c] - co[s].a2*p->bq_y_nm2[s][c];
+	    p->bq_x_nm2[s][c] = p->bq_x_nm1[s][c];  p->bq_x_nm1[s][c] = x;
+	    p->bq_y_nm2[s][c] = p->bq_y_nm1[s][c];  p->bq_y_nm1[s][c] = y;
+	    x = y;
+	}
+	out[c] = (int)(x * scale);
+    }
+#endif
+}
+
+// The 5-point derivative (see Deriv5pt in ptc_pipeline.hpp) on every lane.
+// hist[] is a ring of the last five inputs; hist[ptr] is the oldest. We
+// compute the derivative from the old history and then overwrite the oldest
+// entry with the new input.
+static void multi_deriv (int hist[PTC_DERIV_TAPS][PTC_MAX_CHANNELS], int ptr,
+			 int n_lanes, const int *in, int *out) {
+    const int *xm2 = hist[ptr];
+    const int *xm1 = hist[(ptr+1) % PTC_DERIV_TAPS];
+    const int *xp1 = hist[(ptr+3) % PTC_DERIV_TAPS];
+    const int *xp2 = hist[(ptr+4) % PTC_DERIV_TAPS];
+    for (int c=0; c<n_lanes; ++c)
+	out[c] = (-xm2[c] - 2*xm1[c] + 2*xp1[c] + xp2[c]) >> 3;
+    for (int c=0; c<n_lanes; ++c)
+	hist[ptr][c] = in[c];
+}
+
+// PeakFinder (ptc_pipeline.hpp) on every lane: out[c] is in[c] when the
+// derivative just went from >=0 to <0, and 0 otherwise.
+static void multi_peak (int hist[PTC_DERIV_TAPS][PTC_MAX_CHANNELS], int ptr,
+			int *prev_deriv, int n_lanes, const int *in, int *out) {
+    int deriv[PTC_MAX_CHANNELS];
+    multi_deriv (hist, ptr, n_lanes, in, deriv);
+    for (int c=0; c<n_lanes; ++c) {
+	int peak = (prev_deriv[c] >= 0) & (deriv[c] < 0);
+	prev_deriv[c] = deriv[c];
+	out[c] = peak ? in[c] : 0;
+    }
+}
+
+// threshold() on every lane, with the branches turned into selects.
+static void multi_threshold (int *thresh, int *max, int *min, int decay,
+			     int n_lanes, const int *psample, int *out) {
+    for (int c=0; c<n_lanes; ++c) {
+	int ps = psample[c];
+	int hi = (ps > max[c]) ? ps : max[c];
+	int lo = (ps < min[c]) ? ps : min[c];
+	hi -= decay;  hi = (hi < 0x000) ? 0x000 : hi;
+	lo += decay;  lo = (lo > 0xFFF) ? 0xFFF : lo;
+	int t = (lo + hi) / 2;
+
+	// A sample that isn't a peak changes nothing.
+	int is_peak = ps > 0;
+	max[c] = is_peak ? hi : max[c];
+	min[c] = is_peak ? lo : min[c];
+	thresh[c] = is_peak ? t : thresh[c];
+	out[c] = thresh[c];
+    }
+}
+
+void ptc_multi_step (struct ptc_multi *p, const int *samples,
+		     struct ptc_multi_out *out) {
+    const int n_lanes = p->n_lanes;
+    int in[PTC_MAX_CHANNELS] = {0}, deriv_sq_2[PTC_MAX_CHANNELS];
+    memcpy (in, samples, p->n_ch * sizeof (int));
+
+    // Lowpass.
+    multi_lowpass (p, in, out->filtered);
+
+    // Left side: peaks of the filtered signal, and their moving threshold.
+    multi_peak (p->peak1_hist, p->deriv_ptr, p->peak1_prev_deriv, n_lanes,
+		out->filtered, out->peak_1);
+    multi_threshold (p->thresh1, p->thresh1_max, p->thresh1_min,
+		     THRESH1_DECAY, n_lanes, out->peak_1, out->thresh_1);
+
+    // Right side: squared derivative, averaged over 200ms.
+    multi_deriv (p->deriv2_hist, p->deriv_ptr, n_lanes, out->filtered,
+		 out->deriv_2);
+    for (int c=0; c<n_lanes; ++c)
+	deriv_sq_2[c] = out->deriv_2[c] * out->deriv_2[c];
+    int *oldest = p->window_buf[p->window_ptr];
+    for (int c=0; c<n_lanes; ++c) {
+	p->window_sum[c] += deriv_sq_2[c] - oldest[c];
+	oldest[c] = deriv_sq_2[c];
+	out->avg_200ms_2[c] = p->window_sum[c] / PTC_WINDOW_SIZE;
+    }
+    multi_peak (p->peak2_hist, p->deriv_ptr, p->peak2_prev_deriv, n_lanes,
+		out->avg_200ms_2, out->peak_2);
+
+    // All the rings advance together.
+    if (++p->deriv_ptr == PTC_DERIV_TAPS) p->deriv_ptr = 0;
+    if (++p->window_ptr == PTC_WINDOW_SIZE) p->window_ptr = 0;
+
+    // Ignore startup artifacts: until the warm-up is done, the right-side
+    // threshold and dual_QRS don't update.
+    if (p->sample_count < PTC_WARMUP_SAMPLES-1) {
+	++p->sample_count;
+	for (int c=0; c<n_lanes; ++c) {
+	    out->thresh_2[c] = p->thresh2[c];
+	    out->dual_QRS[c] = p->dual_QRS[c];
+	    out->dual_QRS_rise[c] = 0;
+	}
+	return;
+    }
+    multi_threshold (p->thresh2, p->thresh2_max, p->thresh2_min,
+		     THRESH2_DECAY, n_lanes, out->peak_2, out->thresh_2);
+
+    // Dual-QRS, with its refractory period, per channel.
+    for (int c=0; c<n_lanes; ++c) {
+	int last = p->dual_QRS[c];
+	int refr = p->refractory_counter[c] + 1;
+	int dual = (out->filtered[c] > out->thresh_1[c])
+		 & (out->avg_200ms_2[c] > out->thresh_2[c])
+		 & (refr > PTC_REFRACTORY_TICKS);
+	p->refractory_counter[c] = (last & !dual) ? 0 : refr;
+	p->dual_QRS[c] = dual;
+	out->dual_QRS[c] = dual;
+	out->dual_QRS_rise[c] = dual & !last;
+    }
+}
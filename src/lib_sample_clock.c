@@ -0,0 +1,112 @@
+//****************************************************
+// Sample-clock deadline bookkeeping. See lib_sample_clock.h.
+//****************************************************
+
+#include <string.h>
+#include "lib_sample_clock.h"
+
+bool sample_clock_init (struct sample_clock *sc, uint32_t rate_hz,
+			uint32_t block_samples, uint32_t counts_per_us) {
+    memset (sc, 0, sizeof *sc);
+    if ((rate_hz == 0) || (block_samples == 0) || (counts_per_us == 0))
+	return (false);
+    uint64_t counts = (uint64_t) block_samples * counts_per_us * 1000000;
+    if ((counts % rate_hz != 0) || (counts / rate_hz > 0x7FFFFFFF))
+	return (false);
+    sc->period = (uint32_t) (counts / rate_hz);
+    sc->block_samples = block_samples;
+    sc->counts_per_us = counts_per_us;
+    return (true);
+}
+
+void sample_clock_start (struct sample_clock *sc, uint32_t now) {
+    sc->t_start = sc->last_arrival = now;
+}
+
+// Which histogram bucket a lateness (in counts) goes in. Early (which can
+// only be by the jitter of reading the counter) counts as on time.
+static int bucket (const struct sample_clock *sc, int32_t late) {
+    if (late <= 0)
+	return (0);
+    uint32_t us = (uint32_t) late / sc->counts_per_us;
+    int b = (us == 0) ? 0 : 32 - __builtin_clz (us);
+    return ((b < SAMPLE_CLOCK_N_BUCKETS) ? b : SAMPLE_CLOCK_N_BUCKETS-1);
+}
+
+void sample_clock_arrived (struct sample_clock *sc, uint32_t now) {
+    // Block k (from 0) has filled at t_start + (k+1)*period. The
+    // multiplication wraps just as the counter does.
+    uint32_t k = sc->n_arrived++;
+    uint32_t release = sc->t_start + (k+1) * sc->period;
+    int32_t late = (int32_t) (now - release);
+    ++sc->arrival_hist[bucket (sc, late)];
+    if (late >= (int32_t) sc->period)
+	++sc->n_overruns;
+    if ((late > 0) && ((uint32_t) late > sc->max_arrival_late))
+	sc->max_arrival_late = late;
+    sc->elapsed += now - sc->last_arrival;
+    sc->last_arrival = now;
+}
+
+void sample_clock_done (struct sample_clock *sc, uint32_t now,
+			uint32_t n_through) {
+    if (n_through == 0)
+	return;
+    // The last sample processed came in block (n_through-1)/block_samples,
+    // which was released a period after that block started.
+    uint32_t k = (n_through - 1) / sc->block_samples;
+    uint32_t release = sc->t_start + (k+1) * sc->period;
+    int32_t late = (int32_t) (now - release);
+    ++sc->n_checked;
+    ++sc->done_hist[bucket (sc, late)];
+    if (late > (int32_t) sc->period)
+	++sc->n_missed;
+    if ((late > 0) && ((uint32_t) late > sc->max_done_late))
+	sc->max_done_late = late;
+}
+
+void sample_clock_get_stats (const struct sample_clock *sc,
+			     struct sample_clock_stats *stats) {
+    uint64_t samples = (uint64_t) sc->n_arrived * sc->block_samples;
+    uint64_t elapsed_us = sc->elapsed / sc->counts_per_us;
+    stats->rate_mhz = (elapsed_us == 0) ? 0
+		    : (uint32_t) (samples * 1000000000ull / elapsed_us);
+    stats->n_arrived = sc->n_arrived;
+    stats->n_overruns = sc->n_overruns;
+    stats->max_arrival_late_us = sc->max_arrival_late / sc->counts_per_us;
+    stats->n_checked = sc->n_checked;
+    stats->n_missed = sc->n_missed;
+    stats->max_done_late_us = sc->max_done_late / sc->counts_per_us;
+    memcpy (stats->arrival_hist, sc->arrival_hist, sizeof sc->arrival_hist);
+    memcpy (stats->done_hist, sc->done_hist, sizeof sc->done_hist);
+}
+
+void sample_clock_stats_to_words (const struct sample_clock_stats *stats,
+				  uint32_t *words) {
+    words[0] = stats->rate_mhz;
+    words[1] = stats->n_arrived;
+    words[2] = stats->n_overruns;
+    words[3] = stats->max_arrival_late_us;
+    words[4] = stats->n_checked;
+    words[5] = stats->n_missed;
+    words[6] = stats->max_done_late_us;
+    for (int b=0; b<SAMPLE_CLOCK_N_BUCKETS; ++b) {
+	words[7+b] = stats->arrival_hist[b];
+	words[7+SAMPLE_CLOCK_N_BUCKETS+b] = stats->done_hist[b];
+    }
+}
+
+void sample_clock_stats_from_words (const uint32_t *words,
+				    struct sample_clock_stats *stats) {
+    stats->rate_mhz = words[0];
+    stats->n_arrived = words[1];
+    stats->n_overruns = words[2];
+    stats->max_arrival_late_us = words[3];
+    stats->n_checked = words[4];
+    stats->n_missed = words[5];
+    stats->max_done_late_us = words[6];
+    for (int b=0; b<SAMPLE_CLOCK_N_BUCKETS; ++b) {
+	stats->arrival_hist[b] = words[7+b];
+	stats->done_hist[b] = words[7+SAMPLE_CLOCK_N_BUCKETS+b];
+    }
+}
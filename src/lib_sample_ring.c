@@ -0,0 +1,92 @@
+//****************************************************
+// Lock-free SPSC sample ring. See lib_sample_ring.h.
+//****************************************************
+
+#include "lib_sample_ring.h"
+
+// We use GCC's __atomic builtins rather than C11 _Atomic, so that the struct
+// stays plain C that the C++ host tools can include too. On the M4 an
+// acquire load is a load and a DMB, and a release store a DMB and a store;
+// on the host they're plain loads and stores that ThreadSanitizer
+// understands.
+#define LOAD_ACQUIRE(p)		__atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)	__atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define LOAD_RELAXED(p)		__atomic_load_n ((p), __ATOMIC_RELAXED)
+#define STORE_RELAXED(p, v)	__atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+
+bool sample_ring_init (struct sample_ring *r, uint16_t *buf, uint32_t size) {
+    if ((size == 0) || ((size & (size-1)) != 0))
+	return (false);
+    r->buf = buf;
+    r->size = size;
+    r->head = r->tail = 0;
+    r->n_overflows = r->high_water = 0;
+    return (true);
+}
+
+bool sample_ring_push (struct sample_ring *r, uint16_t sample) {
+    uint32_t head = r->head;			// Ours, so no need to be atomic.
+    uint32_t used = head - LOAD_ACQUIRE (&r->tail);
+    if (used >= r->size) {
+	STORE_RELAXED (&r->n_overflows, r->n_overflows + 1);
+	return (false);
+    }
+    r->buf[head & (r->size-1)] = sample;
+    STORE_RELEASE (&r->head, head + 1);		// Publish the sample.
+    if (used + 1 > r->high_water)
+	STORE_RELAXED (&r->high_water, used + 1);
+    return (true);
+}
+
+uint32_t sample_ring_push_block (struct sample_ring *r, const uint16_t *in,
+				 uint32_t n) {
+    uint32_t head = r->head;
+    uint32_t used = head - LOAD_ACQUIRE (&r->tail);
+    uint32_t fit = r->size - used;
+    if (fit < n) {
+	STORE_RELAXED (&r->n_overflows, r->n_overflows + (n - fit));
+	n = fit;
+    }
+    uint32_t mask = r->size - 1;
+    for (uint32_t i=0; i<n; ++i)
+	r->buf[(head + i) & mask] = in[i];
+    STORE_RELEASE (&r->head, head + n);
+    if (used + n > r->high_water)
+	STORE_RELAXED (&r->high_water, used + n);
+    return (n);
+}
+
+// Copy out in at most two pieces (before and after the wrap), then give the
+// slots back all at once.
+uint32_t sample_ring_pop_block (struct sample_ring *r, uint16_t *out,
+				uint32_t max) {
+    uint32_t tail = r->tail;			// Ours.
+    uint32_t n = LOAD_ACQUIRE (&r->head) - tail;
+    if (n > max)
+	n = max;
+    uint32_t mask = r->size - 1, first = r->size - (tail & mask);
+    if (first > n)
+	first = n;
+    const uint16_t *src = r->buf + (tail & mask);
+    for (uint32_t i=0; i<first; ++i)
+	out[i] = src[i];
+    for (uint32_t i=first; i<n; ++i)
+	out[i] = r->buf[i-first];
+    STORE_RELEASE (&r->tail, tail + n);		// Free the slots.
+    return (n);
+}
+
+// Read tail first: head is never behind tail and only grows, so reading it
+// second can't give a negative count.
+uint32_t sample_ring_count (const struct sample_ring *r) {
+    uint32_t tail = LOAD_ACQUIRE (&r->tail);
+    return (LOAD_ACQUIRE (&r->head) - tail);
+}
+
+void sample_ring_get_stats (const struct sample_ring *r,
+			    struct sample_ring_stats *stats) {
+    stats->n_pushed = LOAD_RELAXED (&r->head);
+    stats->n_popped = LOAD_RELAXED (&r->tail);
+    stats->n_overflows = LOAD_RELAXED (&r->n_overflows);
+    stats->high_water = LOAD_RELAXED (&r->high_water);
+}
@@ -0,0 +1,98 @@
+//****************************************************
+// Telemetry frames. See lib_telemetry.h.
+//****************************************************
+
+#include "lib_telemetry.h"
+
+// CRC-16/CCITT a nibble at a time: a 16-entry table is small enough for the
+// board's flash and still only two lookups per byte.
+static const uint16_t crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t ptc_tlm_crc16 (const uint8_t *data, uint32_t n) {
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i=0; i<n; ++i) {
+	crc = (uint16_t) ((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (data[i] >> 4)]);
+	crc = (uint16_t) ((crc << 4) ^ crc16_nibble[(crc >> 12) ^ (data[i] & 0xF)]);
+    }
+    return (crc);
+}
+
+static void put16 (uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+static void put32 (uint8_t *p, int32_t v) {
+    uint32_t u = (uint32_t) v;
+    for (int i=0; i<4; ++i)
+	p[i] = (uint8_t) (u >> (8*i));
+}
+static uint16_t get16 (const uint8_t *p) {
+    return ((uint16_t) (p[0] | (p[1] << 8)));
+}
+static int32_t get32 (const uint8_t *p) {
+    return ((int32_t) ((uint32_t)p[0] | ((uint32_t)p[1] << 8)
+		       | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)));
+}
+
+void ptc_tlm_pack (uint8_t *out, uint16_t seq, int sample,
+		   const struct ptc_tick *tick) {
+    const int32_t signals[PTC_TLM_N_SIGNALS] = {
+	sample, tick->filtered, tick->peak_1, tick->thresh_1, tick->deriv_2,
+	tick->deriv_sq_2, tick->avg_200ms_2, tick->peak_2, tick->thresh_2 };
+    out[0] = PTC_TLM_SYNC0;
+    out[1] = PTC_TLM_SYNC1;
+    put16 (out+2, seq);
+    for (int s=0; s<PTC_TLM_N_SIGNALS; ++s)
+	put32 (out + 4 + 4*s, signals[s]);
+    out[40] = (tick->warm ? PTC_TLM_WARM : 0)
+	    | (tick->dual_QRS ? PTC_TLM_DUAL_QRS : 0)
+	    | (tick->dual_QRS_rise ? PTC_TLM_DUAL_QRS_RISE : 0);
+    put16 (out+41, ptc_tlm_crc16 (out+2, 39));
+}
+
+bool ptc_tlm_unpack (const uint8_t *in, struct ptc_tlm_frame *f) {
+    if ((in[0] != PTC_TLM_SYNC0) || (in[1] != PTC_TLM_SYNC1)
+	|| (get16 (in+41) != ptc_tlm_crc16 (in+2, 39)))
+	return (false);
+    f->seq = get16 (in+2);
+    for (int s=0; s<PTC_TLM_N_SIGNALS; ++s)
+	f->signals[s] = get32 (in + 4 + 4*s);
+    f->flags = in[40];
+    return (true);
+}
+
+uint32_t ptc_tlm_pack_report (uint8_t *out, uint8_t type,
+			      const uint32_t *words, uint32_t n_words) {
+    if (n_words > PTC_TLM_MAX_WORDS)
+	return (0);
+    out[0] = PTC_TLM_SYNC0;
+    out[1] = PTC_TLM_REPORT_SYNC1;
+    out[2] = type;
+    out[3] = (uint8_t) n_words;
+    for (uint32_t w=0; w<n_words; ++w)
+	put32 (out + 4 + 4*w, (int32_t) words[w]);
+    put16 (out + 4 + 4*n_words, ptc_tlm_crc16 (out+2, 2 + 4*n_words));
+    return (PTC_TLM_REPORT_SIZE (n_words));
+}
+
+int ptc_tlm_unpack_report (const uint8_t *in, uint32_t avail,
+			   struct ptc_tlm_report *r) {
+    if (avail < 4)
+	return (-1);
+    if ((in[0] != PTC_TLM_SYNC0) || (in[1] != PTC_TLM_REPORT_SYNC1)
+	|| (in[3] > PTC_TLM_MAX_WORDS))
+	return (0);
+    uint32_t n_words = in[3];
+    if (avail < PTC_TLM_REPORT_SIZE (n_words))
+	return (-1);
+    if (get16 (in + 4 + 4*n_words) != ptc_tlm_crc16 (in+2, 2 + 4*n_words))
+	return (0);
+    r->type = in[2];
+    r->n_words = (uint8_t) n_words;
+    for (uint32_t w=0; w<n_words; ++w)
+	r->words[w] = (uint32_t) get32 (in + 4 + 4*w);
+    return ((int) PTC_TLM_REPORT_SIZE (n_words));
+}
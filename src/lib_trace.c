@@ -0,0 +1,146 @@
+//****************************************************
+// Scheduler tracer. See lib_trace.h.
+//****************************************************
+
+#include <string.h>
+#include "lib_trace.h"
+#include "lib_profile.h"
+
+// The kernel calls us from tasks, from ISRs and from its own critical
+// sections, so each event is written with interrupts off (PRIMASK, which
+// nests, unlike taskENTER_CRITICAL() from an ISR). The host, which only
+// ever decodes, has no need of it.
+#if defined(__arm__)
+#define TRACE_LOCK()	uint32_t primask = __get_PRIMASK (); __disable_irq ()
+#define TRACE_UNLOCK()	__set_PRIMASK (primask)
+#else
+#define TRACE_LOCK()	do { } while (0)
+#define TRACE_UNLOCK()	do { } while (0)
+#endif
+
+// head counts events forever; the ring holds the last PTC_TRACE_N_EVENTS
+// of them. 'base' is where head was when the ring was last read out.
+static struct {
+    struct ptc_trace_event events[PTC_TRACE_N_EVENTS];
+    uint32_t head, base;
+    bool frozen;
+    uint32_t n_tasks;
+    struct {
+	uint32_t task;
+	char name[PTC_TRACE_NAME_LEN];
+    } tasks[PTC_TRACE_MAX_TASKS];
+} trace;
+
+void ptc_trace_event (uint8_t type, uint32_t task, uint32_t arg) {
+    TRACE_LOCK ();
+    if (!trace.frozen) {
+	struct ptc_trace_event *e
+	    = &trace.events[trace.head++ & (PTC_TRACE_N_EVENTS-1)];
+	e->time = ptc_prof_now ();
+	e->type = type;
+	e->task = (uint8_t) task;
+	e->arg = (uint16_t) arg;
+    }
+    TRACE_UNLOCK ();
+}
+
+void ptc_trace_task_created (uint32_t task, const char *name) {
+    TRACE_LOCK ();
+    if (trace.n_tasks < PTC_TRACE_MAX_TASKS) {
+	trace.tasks[trace.n_tasks].task = task;
+	strncpy (trace.tasks[trace.n_tasks].name, name, PTC_TRACE_NAME_LEN);
+	++trace.n_tasks;
+    }
+    TRACE_UNLOCK ();
+}
+
+void ptc_trace_freeze (bool frozen) {
+    TRACE_LOCK ();
+    if (trace.frozen && !frozen)
+	trace.base = trace.head;	// Thawing: we've read it out.
+    trace.frozen = frozen;
+    TRACE_UNLOCK ();
+}
+
+// How many events there are to read out, from the oldest at index 0.
+static uint32_t n_available (void) {
+    uint32_t n = trace.head - trace.base;
+    return ((n < PTC_TRACE_N_EVENTS) ? n : PTC_TRACE_N_EVENTS);
+}
+
+// A name as 4 words, little-endian, and back.
+static void name_to_words (const char *name, uint32_t *words) {
+    for (int w=0; w<4; ++w) {
+	words[w] = 0;
+	for (int b=0; b<4; ++b)
+	    words[w] |= (uint32_t) (uint8_t) name[4*w+b] << (8*b);
+    }
+}
+static void name_from_words (const uint32_t *words, char *name) {
+    for (int i=0; i<PTC_TRACE_NAME_LEN; ++i)
+	name[i] = (char) (words[i/4] >> (8 * (i%4)));
+    name[PTC_TRACE_NAME_LEN] = '\0';
+}
+
+uint32_t ptc_trace_info_words (uint32_t *words) {
+    uint32_t n = n_available ();
+    words[0] = ptc_prof_counts_per_us ();
+    words[1] = n;
+    words[2] = trace.head - trace.base - n;
+    words[3] = trace.n_tasks;
+    for (uint32_t t=0; t<trace.n_tasks; ++t) {
+	words[4 + 5*t] = trace.tasks[t].task;
+	name_to_words (trace.tasks[t].name, &words[5 + 5*t]);
+    }
+    return (4 + 5*trace.n_tasks);
+}
+
+uint32_t ptc_trace_chunk_words (uint32_t first, uint32_t *words) {
+    uint32_t n = n_available (), oldest = trace.head - n, w = 0;
+    words[w++] = first;
+    for (uint32_t i=first; (i < n) && (i < first + PTC_TRACE_CHUNK); ++i) {
+	const struct ptc_trace_event *e
+	    = &trace.events[(oldest + i) & (PTC_TRACE_N_EVENTS-1)];
+	words[w++] = e->time;
+	words[w++] = e->type | ((uint32_t) e->task << 8)
+		   | ((uint32_t) e->arg << 16);
+    }
+    return (w);
+}
+
+bool ptc_trace_info_from_words (const uint32_t *words, uint32_t n_words,
+				struct ptc_trace_info *info) {
+    if ((n_words < 4) || (words[3] > PTC_TRACE_MAX_TASKS)
+	|| (n_words != 4 + 5*words[3]))
+	return (false);
+    info->counts_per_us = words[0];
+    info->n_events = words[1];
+    info->n_lost = words[2];
+    info->n_tasks = words[3];
+    for (uint32_t t=0; t<info->n_tasks; ++t) {
+	info->tasks[t].task = words[4 + 5*t];
+	name_from_words (&words[5 + 5*t], info->tasks[t].name);
+    }
+    return (true);
+}
+
+bool ptc_trace_chunk_from_words (const uint32_t *words, uint32_t n_words,
+				 struct ptc_trace_event *events,
+				 uint32_t n_max, uint32_t *first,
+				 uint32_t *n_events) {
+    if ((n_words < 1) || (n_words % 2 != 1))
+	return (false);
+    uint32_t n = (n_words - 1) / 2;
+    if ((words[0] > n_max) || (n > n_max - words[0]))
+	return (false);
+    *first = words[0];
+    *n_events = n;
+    for (uint32_t i=0; i<n; ++i) {
+	struct ptc_trace_event *e = &events[words[0] + i];
+	e->time = words[1 + 2*i];
+	e->type = (uint8_t) words[2 + 2*i];
+	e->task = (uint8_t) (words[2 + 2*i] >> 8);
+	e->arg = (uint16_t) (words[2 + 2*i] >> 16);
+    }
+    return (true);
+}
@@ -0,0 +1,30 @@
+//****************************************************
+// The board's instantiation of the compile-time PTC pipeline, with the C
+// interface that task_main_loop() calls. See lib_ptc.h and ptc_pipeline.hpp.
+//****************************************************
+
+#include "ptc_pipeline.hpp"
+
+// Statically allocated and constant-initialized; ptc_board_init() does the
+// rest.
+static ptc::Pipeline<ptc::Board> board_pipeline;
+
+bool ptc_board_init (void) {
+    return (board_pipeline.init());
+}
+
+void ptc_board_step (int sample, struct ptc_tick *tick) {
+    *tick = board_pipeline.step (sample);
+}
+
+size_t ptc_board_state_size (void) {
+    return (ptc::Pipeline<ptc::Board>::state_size());
+}
+
+bool ptc_board_save (void *buf, size_t size) {
+    return (board_pipeline.save (buf, size));
+}
+
+bool ptc_board_restore (const void *buf, size_t size) {
+    return (board_pipeline.restore (buf, size));
+}